@@ -14,8 +14,16 @@ rem # Collect all .c and .cpp files for compilation into the 'input' variable.
 for /f %%a in ('forfiles /s /m *.c /c "cmd /c echo @relpath"') do set input=!input! "%%~a"
 for /f %%a in ('forfiles /s /m *.cpp /c "cmd /c echo @relpath"') do set input=!input! "%%~a"
 
+rem # Ship only the asset pack if there is one (write it with the 'pack' console command in dev mode).
+rem # Without a pack, fall back to the loose res files so dev builds still work.
+if exist res\assets.pack (
+	set preload=--preload-file res/assets.pack@res/assets.pack
+) else (
+	set preload=--preload-file res
+)
+
 rem # Compile and link
-call emcc -o bin/web/index.html -Os -flto -Wall -L./lib -lraylib_web -s USE_GLFW=3 -s TOTAL_MEMORY=268435456 --shell-file webshell.html --preload-file res %input%
+call emcc -o bin/web/index.html -Os -flto -Wall -L./lib -lraylib_web -s USE_GLFW=3 -s TOTAL_MEMORY=268435456 --shell-file webshell.html !preload! %input%
 
 rem # Copy the favicon
 copy /y "icon.ico" "bin/web/favicon.ico"
@@ -0,0 +1,63 @@
+#!/bin/bash
+# Builds and runs the headless simulation runner, which doesn't need a window or a GPU.
+# Usage: ./run_headless_linux.sh [scene] [frames] [trace]
+# If a trace path is given, the whole run is recorded into a Chrome trace file there, which you can open in
+# chrome://tracing or https://ui.perfetto.dev. Both the scene and the trace path are relative to the res folder.
+#
+# Unlike the other platforms, the Linux raylib isn't checked in, so setting it up is a required step on every machine
+# (or CI runner) that uses this script:
+#   sudo apt install build-essential libgl1-mesa-dev libx11-dev libxrandr-dev libxi-dev libxcursor-dev libxinerama-dev
+#   git clone --depth 1 --branch 4.2.0 https://github.com/raysan5/raylib.git   # The headers in src/lib are from 4.2.
+#   make -C raylib/src PLATFORM=PLATFORM_DESKTOP
+#   cp raylib/src/libraylib.a lib/libraylib_linux.a
+# The desktop raylib has GLFW built in, so we still have to link against GL and X11, even though we never
+# open a window or touch the GPU. The libraries only have to be installed, a display isn't needed to run.
+cd "$(dirname "$0")" # Set working directory to the directory of the script.
+
+if [ ! -f lib/libraylib_linux.a ];
+then
+	echo "lib/libraylib_linux.a is missing, build raylib for Linux and copy it there first (see the top of this script)."
+	exit 1
+fi
+
+echo "Checking if recompile is needed..."
+recompile=true
+if [ -f bin/linux/WhoStoleTheSun_headless ];
+then
+	recompile=false
+	for file in $(find src -name '*.c'; find src -name '*.cpp'; find src -name '*.h'; find src -name '*.hpp')
+	do
+		if [ $file -nt bin/linux/WhoStoleTheSun_headless ];
+		then
+			recompile=true
+		fi
+	done
+fi
+
+if [ "$recompile" = false ];
+then
+	echo "Recompile not needed."
+else
+	for file in $(find src -name '*.c')
+	do
+		echo "Compiling C file $file..."
+		gcc -std=c11 -O2 -DHEADLESS -c $file -o ${file}_headless.o || exit 1
+	done
+	for file in $(find src -name '*.cpp')
+	do
+		echo "Compiling C++ file $file..."
+		g++ -std=c++17 -O2 -DHEADLESS -c $file -o ${file}_headless.o || exit 1
+	done
+
+	echo "Linking..."
+	mkdir -p bin/linux
+	files=$(find src -name '*_headless.o' | tr '\n' ' ')
+	g++ $files -L./lib -lraylib_linux -lGL -lm -lpthread -ldl -lrt -lX11 -o bin/linux/WhoStoleTheSun_headless
+
+	echo "Deleting temporary files..."
+	find src -name '*_headless.o' -delete
+
+	echo "Done."
+fi
+
+./bin/linux/WhoStoleTheSun_headless "$@"
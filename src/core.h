@@ -114,9 +114,15 @@ void ListDestroy(List(void) *listPointer);
 #define ListAllocateItem(listPointer)\
 	ListAllocate(listPointer, 1)
 
+// Removes all items from the list, but keeps the memory around so the list can be refilled without reallocating.
+#define ListClear(listPointer) do{\
+	if (*(listPointer))\
+		((int *)(*(listPointer)))[-1] = 0;\
+}while(0)
+
 // Removes the last item in the list and returns it.
 #define ListPop(listPointer)\
-	(private_ListPop(listPointer), (*listPointer)[ListCount(*listPointer)])
+	(private_ListPop((void **)(listPointer)), (*listPointer)[ListCount(*listPointer)])
 
 // Removes the item at the given index in the list by swapping it with the last item in the list.
 // This will destroy the order of the list, but if you don't care about the order, it's very fast.
@@ -172,6 +178,9 @@ void SetFloats(float *floats, float value, int count);
 // Copies the given number of bytes from one memory location to another.
 void CopyBytes(void *to, const void *from, int numBytes);
 
+// Same as CopyBytes, but the two memory locations can overlap.
+void MoveBytes(void *to, const void *from, int numBytes);
+
 // Swaps the bytes of a and b.
 void SwapBytes(void *a, void *b, int numBytes);
 
@@ -253,6 +262,9 @@ int TempMark(void);
 // Call TempReset(0) to free all allocated temporary memory. This is done once at the start of each frame.
 void TempReset(int mark);
 
+// Returns the most temporary memory that was ever in use at once, in bytes.
+int GetTempHighWaterMark(void);
+
 // Copies the given bytes to temporary storage.
 void *TempCopy(const void *bytes, int numBytes);
 
@@ -306,8 +318,16 @@ STRUCT(BinaryStream)
 	void *buffer;
 	int size;   // Size of the buffer.
 	int cursor; // Read/write cursor.
+	bool isGrowable; // Writes past the end reallocate the buffer instead of being dropped. See CreateGrowableBinaryStream.
+	bool hasError;   // Set when a write is dropped because it didn't fit. It stays set, so you can check it once after all the writes.
 };
 
+// Creates an empty stream for writing, which grows as needed. Free it with DestroyGrowableBinaryStream.
+BinaryStream CreateGrowableBinaryStream(int initialCapacity);
+
+// Frees the buffer of a stream made with CreateGrowableBinaryStream.
+void DestroyGrowableBinaryStream(BinaryStream *stream);
+
 // Reads a 32-bit integer from the stream and advances the cursor by 4 bytes.
 int ReadInt(BinaryStream *stream);
 
@@ -321,6 +341,7 @@ bool ReadBool(BinaryStream *stream);
 const char *ReadString(BinaryStream *stream);
 
 // Reads a fixed number of bytes from the stream and returns a pointer to them, then advances the cursor by that many bytes.
+// Returns NULL if the stream doesn't have that many bytes left, or the count is negative.
 const void *ReadBytes(BinaryStream *stream, int numBytesToRead);
 
 // Copies a fixed number of bytes from the stream into a buffer, then advances the cursor by the number of bytes read.
@@ -339,40 +360,163 @@ void WriteFloat(BinaryStream *stream, float f);
 void WriteString(BinaryStream *stream, const char *s);
 
 // Writes a fixed number of bytes to the stream and advances the cursor by however many bytes were written.
+// If the bytes don't fit, nothing is written and hasError is set.
 void WriteBytes(BinaryStream *stream, const void *bytes, int numBytesToWrite);
 
+//
+// Text
+//
+
+// A glyph of laid out text, already turned into a textured quad.
+STRUCT(GlyphQuad)
+{
+	float time; // Script paragraphs reveal the glyph once the paragraph time is past this.
+	int cell; // Where the glyph is in the glyph cache, or -1 if it has nothing to draw. Only valid while the glyph cache generation stays the same.
+	Rectangle destination; // Relative to the top left corner of the text box.
+	Vector2 uv0; // Top left corner in the glyph cache page.
+	Vector2 uv1; // Bottom right corner in the glyph cache page.
+};
+
+// Metrics of a glyph, in pixels at the font's base size.
+STRUCT(FontGlyph)
+{
+	int codepoint;
+	int truetypeGlyph; // Index of the glyph in the .ttf file.
+	float advance;
+	Rectangle box; // Relative to where the glyph's line starts, like raylib's GlyphInfo::offsetX/offsetY.
+	int cell; // Where the glyph was last put in the glyph cache, or -1. The glyph might have been evicted since.
+};
+
+STRUCT(GlyphMapping)
+{
+	int codepoint;
+	int glyphIndex;
+};
+
+// A TrueType font whose glyphs are rasterized into the glyph cache the first time they're drawn.
+// Finding a glyph never has to search through all of them like raylib's GetGlyphIndex does.
+STRUCT(GameFont)
+{
+	unsigned char *fileData; // The whole .ttf file, glyphs are read straight out of it.
+	void *truetype; // stbtt_fontinfo. NULL if the font didn't load.
+	int baseSize; // Glyphs are rasterized at this size, and scaled when drawn at other sizes.
+	float truetypeScale;
+	int ascent; // In pixels at the base size.
+	int fallbackGlyph; // Used for codepoints the font doesn't have.
+	int asciiGlyphs[128]; // Index into glyphs for each ASCII codepoint.
+	List(FontGlyph) glyphs; // All ASCII glyphs, and every other glyph that was used so far.
+	List(GlyphMapping) otherGlyphs; // Every non-ASCII codepoint that was used so far, sorted so it can be binary searched.
+};
+
+// Loads a .ttf file. Glyphs are rasterized at the given size when they're first drawn.
+GameFont LoadGameFont(const char *path, int fontSize);
+
+// Unloads the font and removes its glyphs from the glyph cache.
+void UnloadGameFont(GameFont *font);
+
+// Returns the index of the glyph for the given codepoint, or of the fallback glyph if the font doesn't have it.
+int GetGameFontGlyphIndex(GameFont *font, int codepoint);
+
+// Returns how far the glyph advances at the given font size.
+float GetGameFontAdvance(const GameFont *font, int glyphIndex, float fontSize);
+
+// Returns the line height of a font for a particular font size.
+float GetLineHeight(const GameFont *font, float fontSize);
+
+// Returns the quad that DrawTextCodepoint would draw for the glyph, if (x, y) is where the glyph's line starts. Puts the glyph in the glyph cache if it isn't there.
+GlyphQuad GetGlyphQuad(GameFont *font, int glyphIndex, float x, float y, float fontSize);
+
+// Draws glyph quads, moved by the given offset. Quads that come one after another from the same glyph cache page go in a single batch.
+void DrawGlyphQuads(const GlyphQuad *quads, int numQuads, Vector2 offset, Color color);
+
+// Changes every time a glyph is evicted from the glyph cache. Quads baked in an older generation might point to the wrong glyph.
+unsigned GetGlyphCacheGeneration(void);
+
+// Returns how many glyphs are in the glyph cache right now.
+int GetNumCachedGlyphs(void);
+
+// Returns how many atlas pages the glyph cache has.
+int GetNumGlyphCachePages(void);
+
+// Draws a formatted string starting at (x, y) and going right and down.
+void DrawFormat(GameFont *font, float x, float y, float fontSize, Color color, FORMAT_STRING format, ...);
+
+// Same as DrawFormat but takes an explicit varargs pack.
+void DrawFormatVa(GameFont *font, float x, float y, float fontSize, Color color, FORMAT_STRING format, va_list args);
+
+// Draws a formatted string centered at (x, y).
+void DrawFormatCentered(GameFont *font, float x, float y, float fontSize, Color color, FORMAT_STRING format, ...);
+
+// Same as DrawFormatCentered but takes an explicit varargs pack.
+void DrawFormatCenteredVa(GameFont *font, float x, float y, float fontSize, Color color, FORMAT_STRING format, va_list args);
+
 //
 // Script
 //
 
+STRUCT(ScriptCommand)
+{
+	int stringIndex; // Index of the command string in the script's string pool.
+	float time; // The command runs once the paragraph time is past this.
+	bool (*handler)(List(const char *) args); // Looked up when the script is loaded. NULL if the command doesn't exist or its arguments are wrong.
+	List(const char *) args; // Already split up and checked, they point into argBuffer.
+	char *argBuffer;
+};
+
+STRUCT(ExpressionChange)
+{
+	float time; // The expression is active once the paragraph time is past this.
+	int stringIndex; // Index of the expression name in the script's string pool, or -1 for the default expression.
+};
+
+// Where each glyph of a paragraph goes for a particular text box width and font size.
+STRUCT(ParagraphLayout)
+{
+	float width;
+	float fontSize;
+	unsigned glyphCacheGeneration; // The layout is redone if glyphs were evicted from the glyph cache since.
+	List(GlyphQuad) quads; // Sorted by time.
+};
+
 STRUCT(Paragraph)
 {
-	char *speaker;
-	char *text; // [textLength] NOT 0 TERMINATED!
-	int textLength;
+	const char *speaker; // In the script's string pool, or NULL for the default speaker.
 	float duration;
-	List(int) codepoints;
+	int numCodepoints;
+	int *codepoints;
+	int numExpressionChanges;
+	ExpressionChange *expressionChanges; // Sorted by time.
+	int numCommands;
+	ScriptCommand *commands; // Sorted by time.
+	int initialExpression; // Expression carried over from the previous paragraph if the speaker didn't change. Same encoding as ExpressionChange::stringIndex.
+	ParagraphLayout layout; // Computed the first time the paragraph is drawn, and again only if the text box width or font size change.
 };
 
 STRUCT(Script)
 {
-	Font font;
-	Font boldFont;
-	Font italicFont;
-	Font boldItalicFont;
+	GameFont *font;
+	GameFont *boldFont;
+	GameFont *italicFont;
+	GameFont *boldItalicFont;
 	int commandIndex; // Keeps track of which commands have already run so they don't run twice.
-	char *text;
-	List(char) stringPool; // This is where all expressions and speaker names are stored.
-	List(Paragraph) paragraphs;
+	void *arena; // Everything below lives in this one allocation. NULL if the script isn't loaded.
+	int arenaSize;
+	int numParagraphs;
+	Paragraph *paragraphs;
+	int stringPoolSize;
+	char *stringPool; // This is where all expressions, commands, and speaker names are stored, each one only once.
 };
 
-// Loads a script from the given text file.
-Script LoadScript(const char *path, Font regular, Font bold, Font italic, Font boldItalic);
+// Loads a script from the given text file. The parsed script is cached on disk, so next time it doesn't need to be parsed.
+Script LoadScript(const char *path, GameFont *regular, GameFont *bold, GameFont *italic, GameFont *boldItalic);
 
 // Unloads all script memory and nullifies the script.
 void UnloadScript(Script *script);
 
-// Draws the script paragraph at the given index. NOTE: This also executes console commands within the paragraph!
+// Executes the console commands in the paragraph that should have run by the given time. Commands only ever run once (see commandIndex).
+void ExecuteScriptCommands(Script *script, int paragraphIndex, float time);
+
+// Draws the script paragraph at the given index.
 void DrawScriptParagraph(Script *script, int paragraphIndex, Rectangle textBox, float fontSize, Color color, Color shadowColor, float time);
 
 // Gets the current speaker expression at the given time in the paragraph.
@@ -382,16 +526,93 @@ const char *GetScriptExpression(Script script, int paragratphIndex, float time);
 // Sprite
 //
 
+// A frame of a sprite. It's usually a small part of a big shared atlas texture.
+STRUCT(SpriteFrame)
+{
+	Texture texture;
+	Rectangle source;
+};
+
 STRUCT(Sprite)
 {
 	int numFrames;
-	Texture *frames;
+	SpriteFrame *frames;
+};
+
+// The CPU side of a sprite, before its frames are uploaded to the GPU.
+STRUCT(SpriteImages)
+{
+	int numFrames;
+	Image *frames;
 };
 
 Sprite LoadSprite(const char *path);
 
 void UnloadSprite(Sprite sprite);
 
+// Loads and decodes all frames of a sprite without touching the GPU, so this can be called from a worker thread.
+SpriteImages LoadSpriteImages(const char *path);
+
+void UnloadSpriteImages(SpriteImages images);
+
+// Uploads decoded frames to the GPU. Main thread only.
+Sprite LoadSpriteFromImages(SpriteImages images);
+
+// Copies an image into a shared atlas texture, and returns where it ended up. Main thread only.
+SpriteFrame AddToAtlas(Image image);
+
+// Frees up the space that a frame took in the atlas.
+void RemoveFromAtlas(SpriteFrame frame);
+
+int GetNumAtlasPages(void);
+
+//
+// Jobs
+//
+
+// Function that a job runs, it gets passed the job's data pointer.
+typedef void (*JobFunction)(void *data);
+
+// Runs work(data) on a worker thread, and then complete(data) on the main thread during UpdateJobs. Either function can be NULL.
+// Work functions run in parallel with everything else, so they can't touch the GPU, the temporary allocator, or game state.
+void SubmitJob(JobFunction work, JobFunction complete, void *data);
+
+// Runs completion functions of finished jobs until timeBudget seconds have passed. Called once at the start of every frame.
+void UpdateJobs(double timeBudget);
+
+// Blocks until every submitted job has finished and completed.
+void WaitForAllJobs(void);
+
+// Waits for all jobs, then stops the worker threads. Call this once before exiting, no jobs can be submitted after it.
+void ShutdownJobs(void);
+
+//
+// Collision masks
+//
+
+// A 1-bit-per-pixel mask of where objects can't walk.
+STRUCT(CollisionMask)
+{
+	int width;
+	int height;
+	int wordsPerRow;
+	uint64_t *bits;
+};
+
+// Loads an image and thresholds it into a mask: dark pixels are blocked, light pixels are free.
+CollisionMask LoadCollisionMask(const char *path);
+
+void UnloadCollisionMask(CollisionMask mask);
+
+// Checks if the pixel at a position (in mask pixels) is blocked. Anything outside the mask is free.
+bool CheckCollisionMaskPoint(const CollisionMask *mask, Vector2 position);
+
+// Checks if any pixel in row y, from x0 (inclusive) to x1 (exclusive) is blocked.
+bool CheckCollisionMaskSpan(const CollisionMask *mask, int x0, int x1, int y);
+
+// Checks if any pixel that the rectangle touches is blocked.
+bool CheckCollisionMaskRec(const CollisionMask *mask, Rectangle rectangle);
+
 //
 // Sounds
 //
@@ -405,12 +626,62 @@ void PlayTemporarySoundEx(const char *path, float volume, float pitch);
 // Releases all temporary sounds that finished playing. Called once at the end of every frame.
 void UpdateTemporarySounds(void);
 
+//
+// File utilities
+//
+
+// Writes the data to a temporary file next to the given path, flushes it to disk, and then renames it over the path.
+// If we crash or lose power halfway through, the old file is still there, untouched. Safe to call from worker threads (it doesn't log).
+bool SaveFileDataAtomically(const char *path, const void *data, int numBytes);
+
+// Creates the directory if it isn't already there. Its parent directory has to exist. Returns false if the directory still doesn't exist after that.
+bool EnsureDirectoryExists(const char *path);
+
+//
+// Asset pack
+//
+
+// Maps an asset pack into memory. While it's mounted, assets are loaded from the pack instead of loose files.
+bool MountAssetPack(const char *path);
+
+void UnmountAssetPack(void);
+
+// Checks if the mounted asset pack has a file or directory with this path.
+bool IsInAssetPack(const char *path);
+
+// Returns the contents of a packed file, or NULL if it's not in the pack. The memory belongs to the pack.
+const unsigned char *GetPackedFileData(const char *path, int *outSize);
+
+// Returns how many files are in a packed directory, or -1 if the directory isn't in the pack.
+int GetPackedDirectoryFileCount(const char *path);
+
+// Returns the path of the i-th file in a packed directory, sorted by name.
+const char *GetPackedDirectoryFilePath(const char *path, int index);
+
+// Checks if a file or directory exists, either in the asset pack or on disk.
+bool AssetExists(const char *path);
+
+// Loads an image from the asset pack if it's there, or from disk otherwise. These are safe to call from worker threads.
+Image LoadAssetImage(const char *path);
+
+// Loads a wave from the asset pack if it's there, or from disk otherwise.
+Wave LoadAssetWave(const char *path);
+
+// Loads a file from the asset pack if it's there, or from disk otherwise. Free it with UnloadFileData.
+unsigned char *LoadAssetData(const char *path, int *outSize);
+
+// Loads text from the asset pack if it's there, or from disk otherwise. Free it with UnloadFileText.
+char *LoadAssetText(const char *path);
+
+// Packs every asset file in a directory into an asset pack. Hidden files, tooling output, and files the game can't load are left out.
+bool WriteAssetPack(const char *directory, const char *packPath);
+
 //
 // Asset manager
 //
 
-// Loads a collision map asset - currently a grayscale image.
-Image *AcquireCollisionMap(const char *path);
+// Loads a collision map asset - a grayscale image thresholded into a collision mask.
+CollisionMask *AcquireCollisionMap(const char *path);
 
 // Loads a texture asset - we might remove this later and just use sprites.
 Texture *AcquireTexture(const char *path);
@@ -418,15 +689,19 @@ Texture *AcquireTexture(const char *path);
 Sprite *AcquireSprite(const char *path);
 
 // Loads a script asset.
-Script *AcquireScript(const char *path, Font regular, Font bold, Font italic, Font boldItalic);
+Script *AcquireScript(const char *path, GameFont *regular, GameFont *bold, GameFont *italic, GameFont *boldItalic);
 
 Music *AcquireMusic(const char *path);
 
 Sound *AcquireSound(const char *path);
 
-// Releases any asset.
+// Releases any asset. Once nothing references it, it stays in the asset cache for a while, see SetAssetCacheBudget.
 void ReleaseAsset(void *asset);
 
+// Assets are loaded in the background, so Acquire gives back a handle right away, but it stays empty (zeroed)
+// until the asset finishes loading. Returns true once the handle has something in it.
+bool IsAssetReady(const void *asset);
+
 // Completely clones an asset, as if you has acquired it from scratch.
 void *CloneAsset(void *asset);
 
@@ -436,6 +711,26 @@ const char *GetAssetPath(const void *asset);
 // Hot-reloads any changed assets. This called once at the end of every frame.
 void UpdateAllChangedAssets(void);
 
+// Returns how many times assets finished (re)loading so far. Anything that caches data derived from assets can compare this to know when to recompute.
+int GetNumAssetReloads(void);
+
+// Returns how many assets are currently loaded.
+int GetNumAssets(void);
+
+// Assets that nobody references anymore stay loaded until this many bytes of them pile up.
+#define DEFAULT_ASSET_CACHE_BUDGET (64 * 1024 * 1024)
+
+// Sets how many bytes of unreferenced assets to keep loaded, and unloads the least recently released ones that don't fit. 0 unloads assets as soon as they're released.
+void SetAssetCacheBudget(int numBytes);
+
+int GetAssetCacheBudget(void);
+
+// Returns roughly how many bytes the unreferenced (but still loaded) assets take up.
+int GetAssetCacheBytes(void);
+
+// Returns how many unreferenced assets are still loaded.
+int GetNumCachedAssets(void);
+
 //
 // Random
 //
@@ -644,27 +939,11 @@ void DrawTextureCenteredAndFlippedVertically(Texture texture, Vector2 position,
 
 void DrawTextureCenteredScaled(Texture texture, Vector2 position, float scale, Color tint);
 
-//
-// Text
-//
-
-// Loads all ASCII glyphs from the given .ttf file.
-Font LoadFontAscii(const char *path, int fontSize);
-
-// Returns the line height of a font for a particular font size.
-float GetLineHeight(Font font, float fontSize);
+// Draws a sprite frame centered at the given point.
+void DrawSpriteFrameCentered(SpriteFrame frame, Vector2 position, Color tint);
 
-// Draws a formatted string starting at (x, y) and going right and down.
-void DrawFormat(Font font, float x, float y, float fontSize, Color color, FORMAT_STRING format, ...);
-
-// Same as DrawFormat but takes an explicit varargs pack.
-void DrawFormatVa(Font font, float x, float y, float fontSize, Color color, FORMAT_STRING format, va_list args);
-
-// Draws a formatted string centered at (x, y).
-void DrawFormatCentered(Font font, float x, float y, float fontSize, Color color, FORMAT_STRING format, ...);
-
-// Same as DrawFormatCentered but takes an explicit varargs pack.
-void DrawFormatCenteredVa(Font font, float x, float y, float fontSize, Color color, FORMAT_STRING format, va_list args);
+// Draws a sprite frame centered at the given point and flipped vertically.
+void DrawSpriteFrameCenteredAndFlippedVertically(SpriteFrame frame, Vector2 position, Color tint);
 
 //
 // Slab allocator
@@ -806,14 +1085,69 @@ void AddCommand(const char *command, CommandHandler handle, const char *help);
 
 void ExecuteCommand(const char *command);
 
+// Looks up a command and checks the arguments against the usage in its help text, so it can be called directly later, without any parsing.
+// Returns NULL if there's no such command, or if the arguments don't match the usage, in which case outHelp is set to the command's help text.
+CommandHandler BindCommand(const char *name, List(const char *) args, const char **outHelp);
+
 void ShowConsoleGui(void);
 
 void ResetConsole(void);
 
+//
+// Profiler
+//
+
+// Marks the start and end of a named zone that shows up in the profiler. Zones can nest, and they can be used from any thread.
+// The name has to outlive the program (use a string literal). All of these compile to nothing in release builds (NDEBUG).
+#ifdef NDEBUG
+#	define PROFILE_BEGIN(name)
+#	define PROFILE_END()
+#	define PROFILE_FRAME()
+#	define PROFILE_COUNTER(name, value)
+#else
+#	define PROFILE_BEGIN(name) ProfileBegin(name)
+#	define PROFILE_END() ProfileEnd()
+#	define PROFILE_FRAME() ProfileFrame()
+#	define PROFILE_COUNTER(name, value) ProfileCounter(name, value)
+#endif
+
+void ProfileBegin(const char *name);
+
+void ProfileEnd(void);
+
+// Marks the start of a new frame. Called once at the start of every frame from the main thread.
+void ProfileFrame(void);
+
+// Records the current value of a counter, which shows up as a graph in traces. Only call this from the main thread.
+void ProfileCounter(const char *name, double value);
+
+// Starts streaming all zones, counters, and frame markers to a Chrome trace file on a background thread.
+// Open the file in chrome://tracing or https://ui.perfetto.dev to look at it.
+bool StartTrace(void);
+
+// Finishes the trace that's in progress and moves it to the given path.
+bool StopTrace(const char *path);
+
+bool IsTracing(void);
+
+bool IsProfilerGuiOpen(void);
+
+void SetProfilerGuiOpen(bool open);
+
+// Shows the profiler window with a timeline of a recent frame, and min/avg/p99 times of every zone over the last few seconds, if it's open.
+void ShowProfilerGui(void);
+
 //
 // Runtime
 //
 
+// Building with HEADLESS defined gives a runtime that simulates a scene for a number of frames without a window,
+// GPU, or audio device, and reports how long that took. See run_headless_linux.sh.
+
+// Returns the number of seconds since the program started, from a steady clock.
+// Use this instead of raylib's GetTime outside of the game itself, since that one only works once there's a window.
+double GetSteadyTime(void);
+
 // Initialize the game. This is used in runtime.cpp, but should actually be defined by the game.
 void GameInit(void);
 
@@ -840,4 +1174,16 @@ inline Vector2 operator *(float left, Vector2 right) { return { left * right.x,
 inline Vector2 operator /(float left, Vector2 right) { return { left / right.x, left / right.y }; }
 inline Vector2 operator %(float left, Vector2 right) { return { fmodf(left, right.x), fmodf(left, right.y) }; }
 inline bool operator ==(Vector2 v1, Vector2 v2) { if (v1.x == v2.x && v1.y == v2.y) return true; return false; }
+
+// Profiles the rest of the enclosing scope, see PROFILE_BEGIN.
+#ifdef NDEBUG
+#	define PROFILE_SCOPE(name)
+#else
+#	define PROFILE_SCOPE(name) ProfileScope PASTE(profileScope__, __LINE__)(name)
+#endif
+struct ProfileScope
+{
+	ProfileScope(const char *name) { ProfileBegin(name); }
+	~ProfileScope() { ProfileEnd(); }
+};
 #endif
@@ -4,6 +4,7 @@
 #include <sstream>
 #include <algorithm>
 #include <map>
+#include <memory>
 
 
 static std::vector<std::string> SplitStringByCharacter(std::string string, char spacer)
@@ -49,6 +50,7 @@ public:
     }
 
     bool Invoke(List(const char*) args) { return handler(args); }
+    CommandHandler GetHandler() { return handler; }
 
     void SetHelp(std::string pHelp) { help = pHelp; }
     const char* GetHelp() { return help.c_str(); }
@@ -64,6 +66,55 @@ private:
 
 };
 
+// The part of the help text before "  -  " is the usage, like "sound filename:string [volume:float] [pitch:float]".
+// Arguments in [] are optional, and the type after the : tells us how to check the argument.
+static bool ArgsMatchUsage(std::string help, List(const char*) args)
+{
+    std::string usage = help.substr(0, help.find("  -  "));
+    if (usage.find('|') != std::string::npos)
+        return true; // Commands with several forms check their own arguments.
+
+    auto params = SplitStringByCharacter(usage, ' ');
+    params.erase(params.begin()); // The command name.
+
+    int numRequired = 0;
+    for (auto &param : params)
+        if (param[0] != '[')
+            numRequired++;
+
+    int numArgs = ListCount(args);
+    if (numArgs < numRequired || numArgs > (int)params.size())
+        return false;
+
+    for (int i = 0; i < numArgs; i++)
+    {
+        std::string param = params[i];
+        param.erase(std::remove(param.begin(), param.end(), '['), param.end());
+        param.erase(std::remove(param.begin(), param.end(), ']'), param.end());
+
+        size_t colon = param.find(':');
+        if (colon == std::string::npos)
+        {
+            // Not an argument, just a word that has to be there.
+            if (param != args[i])
+                return false;
+            continue;
+        }
+
+        std::string type = param.substr(colon + 1);
+        bool success = true;
+        if (type == "float")
+            ParseCommandFloatArg(args[i], &success);
+        else if (type == "int")
+            ParseCommandIntArg(args[i], &success);
+        else if (type == "bool")
+            ParseCommandBoolArg(args[i], &success);
+        if (!success)
+            return false;
+    }
+    return true;
+}
+
 enum CmdState
 {
     COMMAND_NOT_FOUND,
@@ -159,6 +210,22 @@ public:
         return result;
     }
 
+    CommandHandler BindCommand(const char* name, List(const char*) args, const char** outHelp)
+    {
+        *outHelp = NULL;
+        auto iterator = _commandContainer.find(std::string(name));
+        if (iterator == _commandContainer.end())
+            return NULL;
+
+        auto command = iterator->second;
+        if (!ArgsMatchUsage(command->GetHelp(), args))
+        {
+            *outHelp = command->GetHelp();
+            return NULL;
+        }
+        return command->GetHandler();
+    }
+
     char                        InputBuf[256];
     ImVector<char*>             Items;
     bool                        AutoScroll;
@@ -342,6 +409,11 @@ extern "C" void ExecuteCommand(const char* command)
     g_console.ExecuteCommand(command);
 }
 
+extern "C" CommandHandler BindCommand(const char *name, List(const char *) args, const char **outHelp)
+{
+    return g_console.BindCommand(name, args, outHelp);
+}
+
 extern "C" void ShowConsoleGui()
 {
     g_console.ShowConsoleGui();
@@ -1,7 +1,13 @@
 #include "../core.h"
 
-#include <unordered_map>
 #include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+#	include <sys/inotify.h>
+#	include <unistd.h>
+#	define USE_INOTIFY
+#endif
 
 // We basically store all assets in a big table and reference count them.
 // Whenever you call AcquireXXX(path), we check if an asset with that path 
@@ -11,6 +17,25 @@
 //
 // This allows us to have a powerful editor where you can change the sprites
 // and scripts of all objects without any performance loss / asset duplication.
+//
+// The table is a flat open-addressing hash table (linear probing) that stores the hash of each path next
+// to the asset, so lookups rarely need to compare strings. Every asset knows which slot it's in, so checking
+// whether a pointer is a live asset doesn't need to hash anything. Assets themselves are allocated from a pool.
+//
+// Assets are also hot-reloaded when their files change on disk. On Linux we
+// ask the kernel to tell us about changes (inotify), so a frame where nothing
+// was edited doesn't touch the filesystem at all. Everywhere else we fall back
+// to polling the modification time of every asset, every frame.
+//
+// Files are read and decoded on worker threads (see jobs.cpp), so acquiring an asset never stalls the frame.
+// The handle you get back is valid right away, but it stays zeroed until the main thread uploads the decoded
+// data to the GPU / audio device in UpdateJobs. Hot-reloads go through the same path, and swap the new data in
+// once it's uploaded. Scripts are small text files and are still loaded synchronously.
+//
+// When the reference count of an asset reaches 0, we don't unload it right away. It goes into a "warm" cache
+// instead, where it stays loaded until the cache goes over its byte budget, and then the least recently
+// released assets are unloaded first. Acquiring an asset that's still warm is just a table lookup, which
+// makes reloading the scene, switching sprites in the editor, or playing the same sound over and over cheap.
 
 ENUM(AssetKind)
 {
@@ -27,7 +52,7 @@ STRUCT(Asset)
 {
 	union
 	{
-		Image collisionMap;
+		CollisionMask collisionMap;
 		Texture texture;
 		Sprite sprite;
 		Script script;
@@ -37,14 +62,156 @@ STRUCT(Asset)
 	int referenceCount;
 	AssetKind kind;
 	char path[256];
-	long lastModTime;
+	long lastModTime; // Only used when polling for changes.
+	bool isChanged; // The file watcher saw a change, and the asset is waiting in the changedAssets queue to be reloaded.
+	bool isReady; // Something has been loaded into the union above.
+	bool isPacked; // Loaded from the asset pack, which never changes, so we don't hot-reload it.
+	int numPendingLoads; // Loads that were submitted to a worker thread, but that haven't been uploaded yet.
+	int numBytes; // Roughly how much memory the loaded data takes up.
+	bool isWarm; // Unreferenced, but kept loaded in the warm cache.
+	Asset *prevWarm; // Released before this one.
+	Asset *nextWarm; // Released after this one.
+	unsigned pathHash;
+	int tableIndex; // Where the asset is in the table, or -1 once it's removed.
+	Asset *nextFree; // Next unused asset in the pool.
+};
+
+STRUCT(TableSlot)
+{
+	unsigned hash;
+	Asset *asset; // NULL if the slot is empty.
+};
+
+// Everything a worker thread decodes for an asset, until it can be uploaded on the main thread.
+STRUCT(LoadJob)
+{
+	Asset *asset;
+	List(FILE *) lockedFiles; // Kept open until the upload, see ReloadAsset.
+	union
+	{
+		CollisionMask collisionMap;
+		Image image;
+		SpriteImages sprite;
+		Wave wave;
+	};
+};
+
+STRUCT(WatchedDirectory)
+{
+	int descriptor;
+	char path[256];
 };
 
-// Try to ignore this C++ bullshit :)
-struct Hash { unsigned operator()(const char *string) const { return HashString(string); } };
-struct Equal { bool operator()(const char *a, const char *b) const { return StringsEqual(a, b); } };
+#define ASSETS_PER_POOL_BLOCK 64
+#define MIN_TABLE_CAPACITY 256 // Must be a power of 2.
+
+static TableSlot *table; // [tableCapacity]
+static int tableCapacity;
+static int numAssets;
+static Asset *firstFreeAsset;
+static List(Asset *) changedAssets; // Assets that the file watcher reported as changed, but that we haven't reloaded yet.
+static List(WatchedDirectory) watchedDirectories;
+static int watcher = -1; // -1 if we can't watch files and need to poll.
+static int numReloads;
+static bool triedToInitWatcher;
+static Asset *oldestWarmAsset; // Evicted first.
+static Asset *newestWarmAsset;
+static int numWarmBytes;
+static int warmCacheBudget = DEFAULT_ASSET_CACHE_BUDGET;
+
+static Asset *NewAsset(void)
+{
+	if (not firstFreeAsset)
+	{
+		// Assets are never freed back to the system, but there are only ever a few hundred of them.
+		Asset *block = (Asset *)MemAlloc(ASSETS_PER_POOL_BLOCK * sizeof block[0]);
+		for (int i = ASSETS_PER_POOL_BLOCK - 1; i >= 0; --i)
+		{
+			block[i].kind = ASSET_KIND_ENUM_COUNT; // Not a valid asset, so IsAsset rejects it.
+			block[i].tableIndex = -1;
+			block[i].nextFree = firstFreeAsset;
+			firstFreeAsset = &block[i];
+		}
+	}
+
+	Asset *asset = firstFreeAsset;
+	firstFreeAsset = asset->nextFree;
+	ZeroBytes(asset, sizeof asset[0]); // Zeroed, so the handle is safe to look at before it's ready.
+	asset->tableIndex = -1;
+	return asset;
+}
+static void DeleteAsset(Asset *asset)
+{
+	ASSERT(asset->tableIndex < 0); // Remove it from the table first.
+	asset->kind = ASSET_KIND_ENUM_COUNT;
+	asset->nextFree = firstFreeAsset;
+	firstFreeAsset = asset;
+}
+static void PlaceInTable(Asset *asset)
+{
+	int mask = tableCapacity - 1;
+	int index = (int)(asset->pathHash & (unsigned)mask);
+	while (table[index].asset)
+		index = (index + 1) & mask;
+
+	table[index].hash = asset->pathHash;
+	table[index].asset = asset;
+	asset->tableIndex = index;
+}
+static void AddToTable(Asset *asset)
+{
+	// Keep the table at most 3/4 full, otherwise the probe chains get long.
+	if (4 * (numAssets + 1) > 3 * tableCapacity)
+	{
+		TableSlot *oldTable = table;
+		int oldCapacity = tableCapacity;
+		tableCapacity = oldCapacity ? 2 * oldCapacity : MIN_TABLE_CAPACITY;
+		table = (TableSlot *)MemAlloc(tableCapacity * sizeof table[0]);
+		for (int i = 0; i < oldCapacity; ++i)
+			if (oldTable[i].asset)
+				PlaceInTable(oldTable[i].asset);
+		MemFree(oldTable);
+	}
+
+	PlaceInTable(asset);
+	++numAssets;
+}
+static void RemoveFromTable(Asset *asset)
+{
+	ASSERT(asset->tableIndex >= 0 and table[asset->tableIndex].asset == asset);
+
+	// There are no tombstones, instead we shift back everything after the hole that would no longer be
+	// reachable from its home slot, so lookups can always stop at the first empty slot.
+	int mask = tableCapacity - 1;
+	int hole = asset->tableIndex;
+	table[hole].asset = NULL;
+	asset->tableIndex = -1;
+	--numAssets;
 
-static std::unordered_map<const char *, Asset *, Hash, Equal> table;
+	for (int i = (hole + 1) & mask; table[i].asset; i = (i + 1) & mask)
+	{
+		int home = (int)(table[i].hash & (unsigned)mask);
+		bool isReachable = hole <= i ? (hole < home and home <= i) : (hole < home or home <= i);
+		if (isReachable)
+			continue;
+
+		table[hole] = table[i];
+		table[hole].asset->tableIndex = hole;
+		table[i].asset = NULL;
+		hole = i;
+	}
+}
+static Asset *FindAsset(const char *path, unsigned hash)
+{
+	if (numAssets == 0)
+		return NULL;
+
+	int mask = tableCapacity - 1;
+	for (int i = (int)(hash & (unsigned)mask); table[i].asset; i = (i + 1) & mask)
+		if (table[i].hash == hash and StringsEqual(table[i].asset->path, path))
+			return table[i].asset;
+	return NULL;
+}
 
 static long GetDirectoryModTime(const char *path)
 {
@@ -68,51 +235,463 @@ static long GetFileOrDirectoryModTime(const char *path)
 	else
 		return GetDirectoryModTime(path);
 }
+static void InitWatcher(void)
+{
+	triedToInitWatcher = true;
+	#ifdef USE_INOTIFY
+	{
+		watcher = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (watcher < 0)
+			LogWarning("Couldn't start the file watcher, falling back to polling for asset changes.");
+	}
+	#endif
+}
+static void WatchDirectory(const char *path)
+{
+	#ifdef USE_INOTIFY
+	{
+		if (watcher < 0)
+			return;
+
+		// Watching the same directory twice gives back the same descriptor, so we only need to remember it once.
+		unsigned mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+		int descriptor = inotify_add_watch(watcher, path, mask);
+		if (descriptor < 0)
+		{
+			LogWarning("Couldn't watch directory '%s' for changes, assets in it won't be hot-reloaded.", path);
+			return;
+		}
+
+		for (int i = 0; i < ListCount(watchedDirectories); ++i)
+			if (watchedDirectories[i].descriptor == descriptor)
+				return;
+
+		WatchedDirectory *watched = ListAllocateItem(&watchedDirectories);
+		watched->descriptor = descriptor;
+		CopyString(watched->path, path, sizeof watched->path);
+	}
+	#else
+	UNUSED(path);
+	#endif
+}
+static void WatchAsset(const char *path)
+{
+	if (watcher < 0)
+		return;
+
+	if (not IsPathFile(path))
+	{
+		// Directory assets (sprites) change whenever any file inside of them changes.
+		WatchDirectory(path);
+		return;
+	}
+
+	// We watch the directory the file is in rather than the file itself, because a lot of editors
+	// save by writing a new file and renaming it over the old one, and that would lose a watch on the file.
+	char directory[256];
+	CopyString(directory, path, sizeof directory);
+	char *slash = strrchr(directory, '/');
+	char *backslash = strrchr(directory, '\\');
+	if (backslash > slash)
+		slash = backslash;
+	if (slash)
+		*slash = 0;
+	else
+		CopyString(directory, ".", sizeof directory);
+	WatchDirectory(directory);
+}
+static void MarkAssetAsChanged(const char *path)
+{
+	Asset *asset = FindAsset(path, HashString(path));
+	if (not asset)
+		return;
+
+	if (asset->isChanged or asset->isPacked)
+		return;
+
+	asset->isChanged = true;
+	ListAdd(&changedAssets, asset);
+}
+static void ReadWatcherEvents(void)
+{
+	#ifdef USE_INOTIFY
+	{
+		// inotify hands us a stream of variable size events, they need to be aligned like the event struct.
+		alignas(struct inotify_event) char buffer[4096];
+		for (;;)
+		{
+			ssize_t bytesRead = read(watcher, buffer, sizeof buffer);
+			if (bytesRead <= 0)
+				break; // EAGAIN, nothing else has changed.
+
+			for (char *cursor = buffer; cursor < buffer + bytesRead;)
+			{
+				struct inotify_event *event = (struct inotify_event *)cursor;
+				cursor += sizeof(struct inotify_event) + event->len;
+
+				const char *directory = NULL;
+				for (int i = 0; i < ListCount(watchedDirectories); ++i)
+					if (watchedDirectories[i].descriptor == event->wd)
+						directory = watchedDirectories[i].path;
+				if (not directory)
+					continue;
+
+				MarkAssetAsChanged(directory);
+				if (event->len > 0 and event->name[0])
+				{
+					if (StringsEqual(directory, "."))
+						MarkAssetAsChanged(event->name);
+					else
+						MarkAssetAsChanged(TempFormat("%s/%s", directory, event->name));
+				}
+			}
+		}
+	}
+	#endif
+}
+static bool IsAsset(Asset *asset)
+{
+	return
+		asset and
+		asset->kind >= 0 and asset->kind < ASSET_KIND_ENUM_COUNT and
+		asset->referenceCount >= 0 and
+		asset->tableIndex >= 0 and asset->tableIndex < tableCapacity and
+		table[asset->tableIndex].asset == asset;
+}
+
+static void UnloadAssetData(Asset *asset)
+{
+	if (not asset->isReady)
+		return;
+
+	switch (asset->kind)
+	{
+		case COLLISION_MAP: UnloadCollisionMask(asset->collisionMap); break;
+		case TEXTURE:       UnloadTexture(asset->texture);            break;
+		case SPRITE:        UnloadSprite(asset->sprite);              break;
+		case SCRIPT:        UnloadScript(&asset->script);             break;
+		case SOUND:         UnloadSound(asset->sound);                break;
+	}
+	asset->isReady = false;
+}
+static int EstimateAssetBytes(const Asset *asset)
+{
+	if (not asset->isReady)
+		return 0;
+
+	switch (asset->kind)
+	{
+		case COLLISION_MAP:
+			return asset->collisionMap.height * asset->collisionMap.wordsPerRow * (int)sizeof asset->collisionMap.bits[0];
+		case TEXTURE:
+			return GetPixelDataSize(asset->texture.width, asset->texture.height, asset->texture.format);
+		case SPRITE:
+		{
+			// Frames might share a texture, so we only count the part each one actually uses.
+			int result = asset->sprite.numFrames * (int)sizeof asset->sprite.frames[0];
+			for (int i = 0; i < asset->sprite.numFrames; ++i)
+			{
+				Rectangle source = asset->sprite.frames[i].source;
+				result += 4 * (int)source.width * (int)source.height;
+			}
+			return result;
+		}
+		case SCRIPT:
+		{
+			const Script *script = &asset->script;
+			int result = script->arenaSize;
+			for (int i = 0; i < script->numParagraphs; ++i)
+				result += ListCapacity(script->paragraphs[i].layout.quads) * (int)sizeof script->paragraphs[i].layout.quads[0];
+			return result;
+		}
+		case SOUND:
+			return (int)asset->sound.frameCount * (int)asset->sound.stream.channels * (int)asset->sound.stream.sampleSize / 8;
+	}
+	return 0;
+}
+static void RemoveFromWarmCache(Asset *asset)
+{
+	ASSERT(asset->isWarm);
+	if (asset->prevWarm)
+		asset->prevWarm->nextWarm = asset->nextWarm;
+	else
+		oldestWarmAsset = asset->nextWarm;
+	if (asset->nextWarm)
+		asset->nextWarm->prevWarm = asset->prevWarm;
+	else
+		newestWarmAsset = asset->prevWarm;
+
+	asset->prevWarm = NULL;
+	asset->nextWarm = NULL;
+	asset->isWarm = false;
+	numWarmBytes -= asset->numBytes;
+}
+static void AddToWarmCache(Asset *asset)
+{
+	ASSERT(not asset->isWarm and asset->referenceCount == 0);
+	asset->isWarm = true;
+	asset->prevWarm = newestWarmAsset;
+	asset->nextWarm = NULL;
+	if (newestWarmAsset)
+		newestWarmAsset->nextWarm = asset;
+	else
+		oldestWarmAsset = asset;
+	newestWarmAsset = asset;
+	numWarmBytes += asset->numBytes;
+}
+// Completely unloads an unreferenced asset and removes it from the table.
+static void EvictAsset(Asset *asset)
+{
+	ASSERT(asset->referenceCount == 0);
+	if (asset->isWarm)
+		RemoveFromWarmCache(asset);
+
+	UnloadAssetData(asset);
+
+	if (asset->isChanged)
+	{
+		for (int i = 0; i < ListCount(changedAssets); ++i)
+		{
+			if (changedAssets[i] == asset)
+			{
+				ListSwapRemove(&changedAssets, i);
+				break;
+			}
+		}
+	}
+
+	RemoveFromTable(asset);
+	if (asset->numPendingLoads == 0)
+		DeleteAsset(asset); // Otherwise UploadAsset deletes it when the load finishes.
+}
+// Evicts the least recently released assets until the warm cache fits into the budget.
+static void EvictWarmAssets(int budget)
+{
+	while (oldestWarmAsset and numWarmBytes > budget)
+		EvictAsset(oldestWarmAsset);
+}
+static void AddReference(Asset *asset)
+{
+	if (asset->isWarm)
+		RemoveFromWarmCache(asset);
+	++asset->referenceCount;
+}
+// Call this whenever the loaded data of an asset changes.
+static void UpdateAssetBytes(Asset *asset)
+{
+	int numBytes = EstimateAssetBytes(asset);
+	if (asset->isWarm)
+		numWarmBytes += numBytes - asset->numBytes;
+	asset->numBytes = numBytes;
+}
 static bool AcquireAsset(const char *path, AssetKind kind, Asset **outResult)
 {
 	*outResult = NULL;
 	if (not path or not path[0])
 		return false;
 
-	auto iterator = table.find(path);
-	if (iterator != table.end())
+	unsigned hash = HashString(path);
+	Asset *asset = FindAsset(path, hash);
+	if (asset)
 	{
-		Asset *asset = iterator->second;
 		ASSERT(asset->kind == kind);
 
-		++asset->referenceCount;
+		AddReference(asset);
 		*outResult = asset;
 		return true;
 	}
 
-	if (not FileExists(path))
+	if (not AssetExists(path))
 		return false;
 
-	Asset *asset = new Asset;
+	if (not triedToInitWatcher)
+		InitWatcher();
+
+	asset = NewAsset();
 	asset->kind = kind;
 	asset->referenceCount = 1;
-	asset->lastModTime = GetFileOrDirectoryModTime(path);
+	asset->isPacked = IsInAssetPack(path);
+	if (not asset->isPacked)
+	{
+		if (watcher < 0)
+			asset->lastModTime = GetFileOrDirectoryModTime(path);
+		else if (kind != SOUND and kind != MUSIC) // We don't hot reload these.
+			WatchAsset(path);
+	}
 
 	ASSERT(StringLength(path) < sizeof asset->path - 1);
 	CopyString(asset->path, path, sizeof asset->path);
-
-	table.insert({ asset->path, asset });
+	asset->pathHash = hash;
+	AddToTable(asset);
 
 	*outResult = asset;
 	return false;
 }
-static bool IsAsset(Asset *asset)
+static void UnloadLoadJob(LoadJob *job)
 {
-	return
-		asset and
-		asset->kind >= 0 and asset->kind < ASSET_KIND_ENUM_COUNT and
-		asset->referenceCount >= 0 and
-		table.find(asset->path) != table.end();
+	for (int i = 0; i < ListCount(job->lockedFiles); ++i)
+		fclose(job->lockedFiles[i]);
+	ListDestroy((void **)&job->lockedFiles);
+	delete job;
+}
+// Runs on a worker thread. The asset's kind and path never change after it's created, so it's fine to read them here.
+static void DecodeAsset(void *data)
+{
+	PROFILE_SCOPE("DecodeAsset");
+	LoadJob *job = (LoadJob *)data;
+	const char *path = job->asset->path;
+	switch (job->asset->kind)
+	{
+		case COLLISION_MAP: job->collisionMap = LoadCollisionMask(path); break;
+		case TEXTURE:       job->image = LoadAssetImage(path);            break;
+		case SPRITE:        job->sprite = LoadSpriteImages(path);         break;
+		case SOUND:         job->wave = LoadAssetWave(path);              break;
+	}
+}
+// Runs on the main thread once DecodeAsset is done.
+static void UploadAsset(void *data)
+{
+	PROFILE_SCOPE("UploadAsset");
+	LoadJob *job = (LoadJob *)data;
+	Asset *asset = job->asset;
+	--asset->numPendingLoads;
+
+	if (asset->referenceCount <= 0 and not asset->isWarm)
+	{
+		// The asset was evicted while it was loading, EvictAsset left it to us to delete.
+		switch (asset->kind)
+		{
+			case COLLISION_MAP: UnloadCollisionMask(job->collisionMap); break;
+			case TEXTURE:       UnloadImage(job->image);                break;
+			case SPRITE:        UnloadSpriteImages(job->sprite);        break;
+			case SOUND:         UnloadWave(job->wave);                  break;
+		}
+		if (asset->numPendingLoads == 0)
+			DeleteAsset(asset);
+		UnloadLoadJob(job);
+		return;
+	}
+
+	// For hot-reloads, the old data stays around until the very end, so there's always something to draw.
+	UnloadAssetData(asset);
+	switch (asset->kind)
+	{
+		case COLLISION_MAP:
+		{
+			asset->collisionMap = job->collisionMap;
+		} break;
+
+		case TEXTURE:
+		{
+			#ifdef HEADLESS
+			{
+				// No GPU, but the size is still used for layout.
+				asset->texture.width = job->image.width;
+				asset->texture.height = job->image.height;
+				asset->texture.mipmaps = 1;
+				asset->texture.format = job->image.format;
+			}
+			#else
+			{
+				asset->texture = LoadTextureFromImage(job->image);
+				SetTextureFilter(asset->texture, TEXTURE_FILTER_BILINEAR);
+				SetTextureWrap(asset->texture, TEXTURE_WRAP_CLAMP);
+			}
+			#endif
+			UnloadImage(job->image);
+		} break;
+
+		case SPRITE:
+		{
+			asset->sprite = LoadSpriteFromImages(job->sprite);
+			UnloadSpriteImages(job->sprite);
+		} break;
+
+		case SOUND:
+		{
+			#ifndef HEADLESS // No audio device, so the sound stays silent.
+			asset->sound = LoadSoundFromWave(job->wave);
+			#endif
+			UnloadWave(job->wave);
+		} break;
+	}
+	asset->isReady = true;
+	++numReloads;
+	UpdateAssetBytes(asset);
+	UnloadLoadJob(job);
+	EvictWarmAssets(warmCacheBudget); // A warm asset just got bigger.
+}
+static void StartLoadingAsset(Asset *asset, List(FILE *) lockedFiles)
+{
+	LoadJob *job = new LoadJob();
+	job->asset = asset;
+	job->lockedFiles = lockedFiles;
+	++asset->numPendingLoads;
+	SubmitJob(DecodeAsset, UploadAsset, job);
+}
+
+// Reloads the asset from disk. Returns false if some of the files are still locked, in which case we need to try again later.
+static bool ReloadAsset(Asset *asset)
+{
+	// Sometimes it takes while before the file being updated is completely written.
+	// Until it's completely written, the program that's changing the file holds a lock on the file, so we can't open it.
+	// If that happens, we just skip it for now, eventually it will release the lock and we will be able to open it.
+	List(FILE *) files = NULL;
+
+	if (not IsPathFile(asset->path))
+	{
+		FilePathList contents = LoadDirectoryFiles(asset->path);
+		for (unsigned i = 0; i < contents.count; ++i)
+			ListAdd(&files, fopen(contents.paths[i], "rb"));
+		UnloadDirectoryFiles(contents);
+	}
+	else ListAdd(&files, fopen(asset->path, "rb"));
+
+	bool allOpenSuccessfully = true;
+	for (int i = 0; i < ListCount(files); ++i)
+	{
+		if (not files[i])
+		{
+			allOpenSuccessfully = false;
+			break;
+		}
+	}
+
+	if (not allOpenSuccessfully)
+	{
+		for (int i = 0; i < ListCount(files); ++i)
+			if (files[i])
+				fclose(files[i]);
+		ListDestroy((void **)&files);
+		return false;
+	}
+
+	if (asset->kind == SCRIPT)
+	{
+		GameFont *regular    = asset->script.font;
+		GameFont *bold       = asset->script.boldFont;
+		GameFont *italic     = asset->script.italicFont;
+		GameFont *boldItalic = asset->script.boldItalicFont;
+		UnloadScript(&asset->script);
+		asset->script = LoadScript(asset->path, regular, bold, italic, boldItalic);
+		UpdateAssetBytes(asset);
+
+		for (int i = 0; i < ListCount(files); ++i)
+			fclose(files[i]);
+		ListDestroy((void **)&files);
+		++numReloads;
+		return true;
+	}
+
+	// Aparently if you don't keep a file handle open the whole time we sometimes fail to load.. I have no clue why.
+	// So the load job holds on to them, and closes them once the new data is uploaded.
+	StartLoadingAsset(asset, files);
+	return true;
 }
 
 extern "C"
 {
-	Image *AcquireCollisionMap(const char *path)
+	CollisionMask *AcquireCollisionMap(const char *path)
 	{
 		Asset *asset;
 		if (AcquireAsset(path, COLLISION_MAP, &asset))
@@ -120,8 +699,7 @@ extern "C"
 		if (not asset)
 			return NULL;
 
-		asset->collisionMap = LoadImage(path);
-		ImageFormat(&asset->collisionMap, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
+		StartLoadingAsset(asset, NULL);
 		return &asset->collisionMap;
 	}
 
@@ -133,7 +711,7 @@ extern "C"
 		if (not asset)
 			return NULL;
 
-		asset->sprite = LoadSprite(path);
+		StartLoadingAsset(asset, NULL);
 		return &asset->sprite;
 	}
 
@@ -145,13 +723,11 @@ extern "C"
 		if (not asset)
 			return NULL;
 
-		asset->texture = LoadTexture(path);
-		SetTextureFilter(asset->texture, TEXTURE_FILTER_BILINEAR);
-		SetTextureWrap(asset->texture, TEXTURE_WRAP_CLAMP);
+		StartLoadingAsset(asset, NULL);
 		return &asset->texture;
 	}
 
-	Script *AcquireScript(const char *path, Font regular, Font bold, Font italic, Font boldItalic)
+	Script *AcquireScript(const char *path, GameFont *regular, GameFont *bold, GameFont *italic, GameFont *boldItalic)
 	{
 		Asset *asset;
 		if (AcquireAsset(path, SCRIPT, &asset))
@@ -160,6 +736,8 @@ extern "C"
 			return NULL;
 
 		asset->script = LoadScript(path, regular, bold, italic, boldItalic);
+		asset->isReady = true;
+		UpdateAssetBytes(asset);
 		return &asset->script;
 	}
 
@@ -173,7 +751,7 @@ extern "C"
 		if (not asset)
 			return NULL;
 
-		asset->sound = LoadSound(path);
+		StartLoadingAsset(asset, NULL);
 		return &asset->sound;
 	}
 
@@ -192,16 +770,8 @@ extern "C"
 		if (a->referenceCount > 0)
 			return;
 
-		switch (a->kind)
-		{
-			case COLLISION_MAP: UnloadImage(a->collisionMap); break;
-			case TEXTURE:       UnloadTexture(a->texture);    break;
-			case SCRIPT:        UnloadScript(&a->script);     break;
-			case SOUND:         UnloadSound(a->sound);        break;
-		}
-
-		table.erase(a->path);
-		delete a;
+		AddToWarmCache(a);
+		EvictWarmAssets(warmCacheBudget);
 	}
 
 	void *CloneAsset(void *asset)
@@ -209,10 +779,16 @@ extern "C"
 		Asset *a = (Asset *)asset;
 		if (not IsAsset(a))
 			return NULL;
-		++a->referenceCount;
+		AddReference(a);
 		return a;
 	}
 
+	bool IsAssetReady(const void *asset)
+	{
+		Asset *a = (Asset *)asset;
+		return IsAsset(a) and a->isReady;
+	}
+
 	const char *GetAssetPath(const void *asset)
 	{
 		Asset *a = (Asset *)asset;
@@ -221,89 +797,78 @@ extern "C"
 		return a->path;
 	}
 
-	void UpdateAllChangedAssets(void)
+	int GetNumAssetReloads(void)
 	{
-		for (auto &keyval : table)
-		{
-			Asset *asset = keyval.second;
-			if (asset->kind == SOUND or asset->kind == MUSIC)
-				continue; // We don't hot reload these.
+		return numReloads;
+	}
 
-			if (not FileExists(asset->path))
-				continue;
+	int GetNumAssets(void)
+	{
+		return numAssets;
+	}
 
-			long modTime = GetFileOrDirectoryModTime(asset->path);
-			if (modTime == asset->lastModTime)
-				continue;
+	void SetAssetCacheBudget(int numBytes)
+	{
+		warmCacheBudget = numBytes > 0 ? numBytes : 0;
+		EvictWarmAssets(warmCacheBudget);
+	}
 
-			// Sometimes it takes while before the file being updated is completely written.
-			// Until it's completely written, the program that's changing the file holds a lock on the file, so we can't open it.
-			// If that happens, we just skip it for now, eventually it will release the lock and we will be able to open it.
-			List(FILE *) files = NULL;
-			ListSetAllocator((void **)&files, TempRealloc, TempFree);
+	int GetAssetCacheBudget(void)
+	{
+		return warmCacheBudget;
+	}
 
-			if (not IsPathFile(asset->path))
-			{
-				FilePathList contents = LoadDirectoryFiles(asset->path);
-				for (unsigned i = 0; i < contents.count; ++i)
-					ListAdd(&files, fopen(contents.paths[i], "rb"));
-				UnloadDirectoryFiles(contents);
-			}
-			else ListAdd(&files, fopen(asset->path, "rb"));
+	int GetAssetCacheBytes(void)
+	{
+		return numWarmBytes;
+	}
 
-			bool allOpenSuccessfully = true;
-			for (int i = 0; i < ListCount(files); ++i)
-			{
-				if (not files[i])
-				{
-					allOpenSuccessfully = false;
-					break;
-				}
-			}
+	int GetNumCachedAssets(void)
+	{
+		int result = 0;
+		for (Asset *asset = oldestWarmAsset; asset; asset = asset->nextWarm)
+			++result;
+		return result;
+	}
 
-			if (not allOpenSuccessfully)
+	void UpdateAllChangedAssets(void)
+	{
+		if (watcher >= 0)
+		{
+			ReadWatcherEvents();
+			for (int i = 0; i < ListCount(changedAssets); ++i)
 			{
-				for (int i = 0; i < ListCount(files); ++i)
-					if (files[i])
-						fclose(files[i]);
-				continue;
+				Asset *asset = changedAssets[i];
+				if (asset->numPendingLoads > 0)
+					continue; // Wait for the previous load to finish first.
+				if (FileExists(asset->path) and not ReloadAsset(asset))
+					continue; // Still being written, try again next frame.
+
+				asset->isChanged = false;
+				ListSwapRemove(&changedAssets, i);
+				--i;
 			}
-
-			switch (asset->kind)
+		}
+		else
+		{
+			for (int i = 0; i < tableCapacity; ++i)
 			{
-				case COLLISION_MAP:
-				{
-					UnloadImage(asset->collisionMap);
-					asset->collisionMap = LoadImage(asset->path);
-				} break;
+				Asset *asset = table[i].asset;
+				if (not asset)
+					continue;
+				if (asset->kind == SOUND or asset->kind == MUSIC or asset->isPacked)
+					continue; // We don't hot reload these.
 
-				case TEXTURE:
-				{
-					UnloadTexture(asset->texture);
-					asset->texture = LoadTexture(asset->path);
-				} break;
+				if (not FileExists(asset->path) or asset->numPendingLoads > 0)
+					continue;
 
-				case SPRITE:
-				{
-					UnloadSprite(asset->sprite);
-					asset->sprite = LoadSprite(asset->path);
-				} break;
+				long modTime = GetFileOrDirectoryModTime(asset->path);
+				if (modTime == asset->lastModTime)
+					continue;
 
-				case SCRIPT:
-				{
-					Font regular    = asset->script.font;
-					Font bold       = asset->script.boldFont;
-					Font italic     = asset->script.italicFont;
-					Font boldItalic = asset->script.boldItalicFont;
-					UnloadScript(&asset->script);
-					asset->script = LoadScript(asset->path, regular, bold, italic, boldItalic);
-				} break;
+				if (ReloadAsset(asset))
+					asset->lastModTime = modTime;
 			}
-
-			// Aparently if you don't keep a file handle open the whole time we sometimes fail to load.. I have no clue why.
-			for (int i = 0; i < ListCount(files); ++i)
-				fclose(files[i]);
-			asset->lastModTime = modTime;
 		}
 	}
 }
@@ -0,0 +1,163 @@
+#include "../core.h"
+
+// We only use some of stb_rect_pack, so don't warn about the functions we don't use.
+#ifdef __GNUC__
+#	pragma GCC diagnostic push
+#	pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#define STB_RECT_PACK_IMPLEMENTATION
+#define STBRP_STATIC
+#include "../lib/imgui/imstb_rectpack.h"
+#ifdef __GNUC__
+#	pragma GCC diagnostic pop
+#endif
+
+// Sprite frames are packed into a few big shared textures (pages), so drawing a whole scene only needs
+// a handful of texture binds, and raylib's batcher doesn't have to flush between objects.
+//
+// Every frame gets a border of ATLAS_PADDING pixels around it, filled with copies of its edge pixels.
+// That way bilinear filtering at the edge of a frame never samples its neighbours, and it looks the same
+// as the clamped standalone textures we had before. The skyline packer can't free individual rectangles,
+// so we just count the frames in each page, and free the whole page once it's empty.
+//
+// Each page takes 16 MB of GPU memory. We never make more than MAX_ATLAS_PAGES of them, and once that many are in
+// use, new frames get their own texture like they used to.
+
+#define ATLAS_PAGE_SIZE 2048
+#define ATLAS_PADDING 2
+#define MAX_ATLAS_PAGES 16
+
+STRUCT(AtlasPage)
+{
+	Texture texture;
+	stbrp_context packer; // Careful, this points into itself, so pages can't move in memory.
+	stbrp_node nodes[ATLAS_PAGE_SIZE];
+	int numFrames;
+};
+
+static List(AtlasPage *) pages;
+
+static AtlasPage *AddAtlasPage(void)
+{
+	AtlasPage *page = MemAlloc(sizeof page[0]);
+	stbrp_init_target(&page->packer, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, page->nodes, COUNTOF(page->nodes));
+
+	// Everything we pack overwrites its own padding, so it doesn't matter what's in the texture initially.
+	page->texture.id = rlLoadTexture(NULL, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8, 1);
+	page->texture.width = ATLAS_PAGE_SIZE;
+	page->texture.height = ATLAS_PAGE_SIZE;
+	page->texture.mipmaps = 1;
+	page->texture.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+	SetTextureWrap(page->texture, TEXTURE_WRAP_CLAMP);
+	SetTextureFilter(page->texture, TEXTURE_FILTER_BILINEAR);
+
+	ListAdd(&pages, page);
+	return page;
+}
+
+static SpriteFrame LoadStandaloneFrame(Image image)
+{
+	SpriteFrame frame = { 0 };
+	frame.texture = LoadTextureFromImage(image);
+	SetTextureWrap(frame.texture, TEXTURE_WRAP_CLAMP);
+	SetTextureFilter(frame.texture, TEXTURE_FILTER_BILINEAR);
+	frame.source = (Rectangle) { 0, 0, (float)image.width, (float)image.height };
+	return frame;
+}
+
+SpriteFrame AddToAtlas(Image image)
+{
+	SpriteFrame frame = { 0 };
+	if (not image.data)
+		return frame;
+
+	#ifdef HEADLESS
+	{
+		// No GPU, we only need to know how big the frame is.
+		frame.source = (Rectangle) { 0, 0, (float)image.width, (float)image.height };
+		return frame;
+	}
+	#endif
+
+	int paddedWidth = image.width + 2 * ATLAS_PADDING;
+	int paddedHeight = image.height + 2 * ATLAS_PADDING;
+	if (paddedWidth > ATLAS_PAGE_SIZE or paddedHeight > ATLAS_PAGE_SIZE)
+	{
+		// Doesn't fit in a page, this gets its own texture.
+		return LoadStandaloneFrame(image);
+	}
+
+	stbrp_rect rect = { 0 };
+	rect.w = paddedWidth;
+	rect.h = paddedHeight;
+
+	AtlasPage *page = NULL;
+	for (int i = 0; i < ListCount(pages) and not page; ++i)
+		if (stbrp_pack_rects(&pages[i]->packer, &rect, 1))
+			page = pages[i];
+	if (not page)
+	{
+		if (ListCount(pages) >= MAX_ATLAS_PAGES)
+			return LoadStandaloneFrame(image);
+
+		page = AddAtlasPage();
+		stbrp_pack_rects(&page->packer, &rect, 1);
+	}
+
+	Color *pixels = LoadImageColors(image);
+	Color *padded = MemAlloc(paddedWidth * paddedHeight * sizeof padded[0]);
+	for (int y = 0; y < paddedHeight; ++y)
+	{
+		int sourceY = ClampInt(y - ATLAS_PADDING, 0, image.height - 1);
+		for (int x = 0; x < paddedWidth; ++x)
+		{
+			int sourceX = ClampInt(x - ATLAS_PADDING, 0, image.width - 1);
+			padded[y * paddedWidth + x] = pixels[sourceY * image.width + sourceX];
+		}
+	}
+	UnloadImageColors(pixels);
+
+	Rectangle destination = { (float)rect.x, (float)rect.y, (float)paddedWidth, (float)paddedHeight };
+	UpdateTextureRec(page->texture, destination, padded);
+	MemFree(padded);
+
+	++page->numFrames;
+	frame.texture = page->texture;
+	frame.source = (Rectangle) {
+		(float)(rect.x + ATLAS_PADDING),
+		(float)(rect.y + ATLAS_PADDING),
+		(float)image.width,
+		(float)image.height
+	};
+	return frame;
+}
+
+void RemoveFromAtlas(SpriteFrame frame)
+{
+	if (not frame.texture.id)
+		return;
+
+	for (int i = 0; i < ListCount(pages); ++i)
+	{
+		AtlasPage *page = pages[i];
+		if (page->texture.id == frame.texture.id)
+		{
+			--page->numFrames;
+			if (page->numFrames <= 0)
+			{
+				UnloadTexture(page->texture);
+				MemFree(page);
+				ListSwapRemove(&pages, i);
+			}
+			return;
+		}
+	}
+
+	// Not in any page, so it must have gotten its own texture.
+	UnloadTexture(frame.texture);
+}
+
+int GetNumAtlasPages(void)
+{
+	return ListCount(pages);
+}
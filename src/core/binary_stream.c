@@ -1,4 +1,27 @@
 #include "../core.h"
+#include <stdlib.h>
+#include <limits.h>
+
+BinaryStream CreateGrowableBinaryStream(int initialCapacity)
+{
+	ASSERT(initialCapacity >= 0);
+	BinaryStream stream = { 0 };
+	stream.isGrowable = true;
+	if (initialCapacity > 0)
+	{
+		stream.buffer = malloc((size_t)initialCapacity);
+		if (stream.buffer)
+			stream.size = initialCapacity;
+	}
+	return stream;
+}
+
+void DestroyGrowableBinaryStream(BinaryStream *stream)
+{
+	ASSERT(stream->isGrowable); // This stream doesn't own its buffer!
+	free(stream->buffer);
+	ZeroBytes(stream, sizeof stream[0]);
+}
 
 int ReadInt(BinaryStream *stream)
 {
@@ -43,7 +66,7 @@ const char *ReadString(BinaryStream *stream)
 const void *ReadBytes(BinaryStream *stream, int numBytesToRead)
 {
 	int bytesRemaining = stream->size - stream->cursor;
-	if (bytesRemaining < numBytesToRead)
+	if (numBytesToRead < 0 or bytesRemaining < numBytesToRead)
 		return NULL;
 
 	const void *result = (char *)stream->buffer + stream->cursor;
@@ -54,6 +77,8 @@ const void *ReadBytes(BinaryStream *stream, int numBytesToRead)
 void ReadBytesInto(BinaryStream *stream, void *buffer, int numBytesToRead)
 {
 	int bytesRemaining = stream->size - stream->cursor;
+	if (numBytesToRead < 0)
+		return;
 	if (bytesRemaining < numBytesToRead)
 	{
 		ZeroBytes(buffer, numBytesToRead);
@@ -91,9 +116,33 @@ void WriteString(BinaryStream *stream, const char *s)
 
 void WriteBytes(BinaryStream *stream, const void *bytes, int numBytesToWrite)
 {
+	if (numBytesToWrite < 0)
+	{
+		stream->hasError = true;
+		return;
+	}
+
 	int bytesRemaining = stream->size - stream->cursor;
+	// Past INT_MAX / 2 the doubling below would overflow, and a stream that big is a bug anyway.
+	if (bytesRemaining < numBytesToWrite and stream->isGrowable and numBytesToWrite <= INT_MAX / 2 - stream->cursor)
+	{
+		int newSize = stream->size < 256 ? 256 : stream->size;
+		while (newSize - stream->cursor < numBytesToWrite)
+			newSize *= 2;
+
+		void *newBuffer = realloc(stream->buffer, (size_t)newSize);
+		if (newBuffer)
+		{
+			stream->buffer = newBuffer;
+			stream->size = newSize;
+			bytesRemaining = newSize - stream->cursor;
+		}
+	}
 	if (bytesRemaining < numBytesToWrite)
+	{
+		stream->hasError = true;
 		return;
+	}
 
 	CopyBytes((char *)stream->buffer + stream->cursor, bytes, numBytesToWrite);
 	stream->cursor += numBytesToWrite;
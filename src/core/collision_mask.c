@@ -0,0 +1,97 @@
+#include "../core.h"
+
+// Collision masks store 1 bit per pixel, set wherever the source image is dark (blocked).
+// Every row is padded out to a whole number of 64-bit words, so pixel (x, y) is bit x % 64
+// of word x / 64 in row y. This lets us test a whole row segment a word at a time.
+
+CollisionMask LoadCollisionMask(const char *path)
+{
+	CollisionMask mask = { 0 };
+	Image image = LoadAssetImage(path);
+	if (not image.data)
+	{
+		LogError("Couldn't load collision mask from '%s'.", path);
+		return mask;
+	}
+
+	ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
+	mask.width = image.width;
+	mask.height = image.height;
+	mask.wordsPerRow = (image.width + 63) / 64;
+	mask.bits = MemAlloc(mask.wordsPerRow * mask.height * sizeof mask.bits[0]); // Zeroed.
+
+	const unsigned char *pixels = image.data;
+	for (int y = 0; y < mask.height; ++y)
+	{
+		uint64_t *row = mask.bits + y * mask.wordsPerRow;
+		for (int x = 0; x < mask.width; ++x)
+			if (pixels[y * mask.width + x] < 128)
+				row[x / 64] |= (uint64_t)1 << (x % 64);
+	}
+
+	UnloadImage(image);
+	return mask;
+}
+
+void UnloadCollisionMask(CollisionMask mask)
+{
+	MemFree(mask.bits);
+}
+
+bool CheckCollisionMaskPoint(const CollisionMask *mask, Vector2 position)
+{
+	int x = (int)floorf(position.x);
+	int y = (int)floorf(position.y);
+	if (x < 0 or x >= mask->width or y < 0 or y >= mask->height)
+		return false;
+
+	uint64_t word = mask->bits[y * mask->wordsPerRow + x / 64];
+	return (word >> (x % 64)) & 1;
+}
+
+bool CheckCollisionMaskSpan(const CollisionMask *mask, int x0, int x1, int y)
+{
+	if (y < 0 or y >= mask->height)
+		return false;
+	if (x0 < 0)
+		x0 = 0;
+	if (x1 > mask->width)
+		x1 = mask->width;
+	if (x0 >= x1)
+		return false;
+
+	const uint64_t *row = mask->bits + y * mask->wordsPerRow;
+	int firstWord = x0 / 64;
+	int lastWord = (x1 - 1) / 64;
+	uint64_t firstBits = ~(uint64_t)0 << (x0 % 64);
+	uint64_t lastBits = ~(uint64_t)0 >> (63 - (x1 - 1) % 64);
+
+	if (firstWord == lastWord)
+		return row[firstWord] & firstBits & lastBits;
+
+	if (row[firstWord] & firstBits)
+		return true;
+	for (int i = firstWord + 1; i < lastWord; ++i)
+		if (row[i])
+			return true;
+	return row[lastWord] & lastBits;
+}
+
+bool CheckCollisionMaskRec(const CollisionMask *mask, Rectangle rectangle)
+{
+	// Every pixel that the rectangle touches counts.
+	int x0 = (int)floorf(rectangle.x);
+	int y0 = (int)floorf(rectangle.y);
+	int x1 = (int)ceilf(rectangle.x + rectangle.width);
+	int y1 = (int)ceilf(rectangle.y + rectangle.height);
+	if (y0 < 0)
+		y0 = 0;
+	if (y1 > mask->height)
+		y1 = mask->height;
+
+	for (int y = y0; y < y1; ++y)
+		if (CheckCollisionMaskSpan(mask, x0, x1, y))
+			return true;
+
+	return false;
+}
@@ -58,3 +58,25 @@ void DrawTextureCenteredScaled(Texture texture, Vector2 position, float scale, C
 	position.y -= 0.5f * texture.height;
 	DrawTextureEx(texture, position, 0, scale, tint);
 }
+
+void DrawSpriteFrameCentered(SpriteFrame frame, Vector2 position, Color tint)
+{
+	position.x -= 0.5f * frame.source.width;
+	position.y -= 0.5f * frame.source.height;
+	DrawTextureRec(frame.texture, frame.source, position, tint);
+}
+
+void DrawSpriteFrameCenteredAndFlippedVertically(SpriteFrame frame, Vector2 position, Color tint)
+{
+	Rectangle source = frame.source;
+	source.width = -source.width;
+	Rectangle destination = {
+		position.x - 0.5f * frame.source.width,
+		position.y - 0.5f * frame.source.height,
+		frame.source.width,
+		frame.source.height
+	};
+
+	Vector2 origin = { 0, 0 };
+	DrawTexturePro(frame.texture, source, destination, origin, 0, tint);
+}
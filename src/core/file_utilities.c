@@ -0,0 +1,123 @@
+#include "../core.h"
+#include <stdio.h>
+
+#if defined(_WIN32)
+#	include <io.h>
+#	include <direct.h>
+	// Including windows.h clashes with raylib, so we declare the few functions we need ourselves.
+	__declspec(dllimport) int __stdcall MoveFileExA(const char *existingFileName, const char *newFileName, unsigned long flags);
+#	define MOVEFILE_REPLACE_EXISTING 0x1
+#	define MOVEFILE_WRITE_THROUGH 0x8
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/stat.h>
+#endif
+
+// Writes the whole file and makes sure it's actually on the disk, and not just in some cache.
+static bool WriteFileToDisk(const char *path, const void *data, int numBytes)
+{
+	#ifdef _WIN32
+	{
+		FILE *file = fopen(path, "wb");
+		if (not file)
+			return false;
+
+		bool success = numBytes <= 0 or fwrite(data, 1, (size_t)numBytes, file) == (size_t)numBytes;
+		success = success and fflush(file) == 0 and _commit(_fileno(file)) == 0;
+		return fclose(file) == 0 and success;
+	}
+	#else
+	{
+		int descriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (descriptor < 0)
+			return false;
+
+		bool success = true;
+		const char *bytes = (const char *)data;
+		while (success and numBytes > 0)
+		{
+			ssize_t written = write(descriptor, bytes, (size_t)numBytes);
+			success = written > 0;
+			if (success)
+			{
+				bytes += written;
+				numBytes -= (int)written;
+			}
+		}
+		success = success and fsync(descriptor) == 0;
+		return close(descriptor) == 0 and success;
+	}
+	#endif
+}
+
+// On POSIX, a rename is only durable once the directory it happened in is flushed too.
+static void FlushDirectoryToDisk(const char *path)
+{
+	#ifndef _WIN32
+	{
+		char directory[512];
+		CopyString(directory, path, sizeof directory);
+		char *slash = NULL;
+		for (char *c = directory; *c; ++c)
+			if (*c == '/')
+				slash = c;
+
+		if (slash)
+			*slash = 0;
+		else
+			CopyString(directory, ".", sizeof directory);
+
+		int descriptor = open(directory, O_RDONLY);
+		if (descriptor >= 0)
+		{
+			fsync(descriptor);
+			close(descriptor);
+		}
+	}
+	#else
+	{
+		UNUSED(path); // MOVEFILE_WRITE_THROUGH already takes care of it.
+	}
+	#endif
+}
+
+bool SaveFileDataAtomically(const char *path, const void *data, int numBytes)
+{
+	ASSERT(data or numBytes <= 0);
+
+	char tempPath[512];
+	FormatString(tempPath, sizeof tempPath, "%s.tmp", path);
+	if (not WriteFileToDisk(tempPath, data, numBytes))
+	{
+		remove(tempPath);
+		return false;
+	}
+
+	#ifdef _WIN32
+	bool success = MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+	#else
+	bool success = rename(tempPath, path) == 0;
+	#endif
+	if (not success)
+	{
+		remove(tempPath);
+		return false;
+	}
+
+	FlushDirectoryToDisk(path);
+	return true;
+}
+
+bool EnsureDirectoryExists(const char *path)
+{
+	if (DirectoryExists(path))
+		return true;
+
+	#ifdef _WIN32
+	_mkdir(path);
+	#else
+	mkdir(path, 0755);
+	#endif
+	return DirectoryExists(path); // Someone else might have created it in the meantime, so we can't just check what mkdir returned.
+}
@@ -0,0 +1,160 @@
+#include "../core.h"
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// On the web we don't build with pthreads, so there's nobody else to run jobs.
+// Work functions run right away when submitted, and completion functions still run during UpdateJobs.
+#ifndef __EMSCRIPTEN__
+#	include <thread>
+#	include <vector>
+#	define USE_THREADS
+#endif
+
+// Jobs go through two queues. Workers take jobs from pendingJobs, run the work function, and push them onto
+// finishedJobs. The main thread then takes them from finishedJobs and runs the completion function.
+
+STRUCT(Job)
+{
+	JobFunction work;
+	JobFunction complete;
+	void *data;
+};
+
+static std::mutex mutex;
+static std::condition_variable jobSubmitted;
+static std::condition_variable jobFinished;
+static std::deque<Job> pendingJobs;
+static std::deque<Job> finishedJobs;
+static int numUncompletedJobs; // Only touched from the main thread.
+static bool startedWorkers;
+#ifdef USE_THREADS
+static std::vector<std::thread> workers;
+static bool stopWorkers; // Guarded by the mutex.
+#endif
+
+#ifdef USE_THREADS
+static void WorkerMain(void)
+{
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobSubmitted.wait(lock, [] { return stopWorkers or not pendingJobs.empty(); });
+			if (stopWorkers)
+				return;
+			job = pendingJobs.front();
+			pendingJobs.pop_front();
+		}
+
+		if (job.work)
+			job.work(job.data);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finishedJobs.push_back(job);
+		}
+		jobFinished.notify_one();
+	}
+}
+static void StartWorkers(void)
+{
+	startedWorkers = true;
+
+	// Leave one core for the main thread.
+	int numWorkers = (int)std::thread::hardware_concurrency() - 1;
+	if (numWorkers < 1)
+		numWorkers = 1;
+
+	// Workers sleep when there's nothing to do, until ShutdownJobs wakes them up to exit.
+	for (int i = 0; i < numWorkers; ++i)
+		workers.emplace_back(WorkerMain);
+}
+#endif
+
+extern "C"
+{
+	void SubmitJob(JobFunction work, JobFunction complete, void *data)
+	{
+		Job job = { work, complete, data };
+		++numUncompletedJobs;
+
+		#ifdef USE_THREADS
+		{
+			ASSERT(not stopWorkers); // Nobody is left to run it.
+			if (not startedWorkers)
+				StartWorkers();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pendingJobs.push_back(job);
+			}
+			jobSubmitted.notify_one();
+		}
+		#else
+		{
+			if (job.work)
+				job.work(job.data);
+			finishedJobs.push_back(job);
+		}
+		#endif
+	}
+
+	void UpdateJobs(double timeBudget)
+	{
+		double startTime = GetSteadyTime();
+		for (;;)
+		{
+			Job job;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (finishedJobs.empty())
+					break;
+				job = finishedJobs.front();
+				finishedJobs.pop_front();
+			}
+
+			// Completion functions can submit more jobs, so we only decrement after running them.
+			if (job.complete)
+				job.complete(job.data);
+			--numUncompletedJobs;
+
+			// We always complete at least one job, so that everything eventually finishes even with a tiny budget.
+			if (GetSteadyTime() - startTime >= timeBudget)
+				break;
+		}
+	}
+
+	void WaitForAllJobs(void)
+	{
+		while (numUncompletedJobs > 0)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobFinished.wait(lock, [] { return not finishedJobs.empty(); });
+			}
+			UpdateJobs(DBL_MAX);
+		}
+	}
+
+	void ShutdownJobs(void)
+	{
+		WaitForAllJobs();
+
+		#ifdef USE_THREADS
+		{
+			// The workers have to be gone before the mutex and condition variables they wait on are destroyed at exit.
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopWorkers = true;
+			}
+			jobSubmitted.notify_all();
+			for (std::thread &worker : workers)
+				worker.join();
+			workers.clear();
+		}
+		#endif
+	}
+}
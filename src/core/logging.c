@@ -4,7 +4,7 @@
 
 static void LogInternal(int logLevel, FORMAT_STRING format, va_list args)
 {
-	double t = GetTime();
+	double t = GetSteadyTime();
 	int us = (int)(t * 1e6) % 1000;
 	int ms = (int)(t * 1e3) % 1000;
 	int sec = (int)(t) % 60;
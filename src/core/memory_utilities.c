@@ -39,6 +39,14 @@ void CopyBytes(void *to, const void *from, int numBytes)
 		memcpy(to, from, (size_t)numBytes);
 }
 
+void MoveBytes(void *to, const void *from, int numBytes)
+{
+	ASSERT((to and from) or numBytes <= 0);
+
+	if (numBytes > 0)
+		memmove(to, from, (size_t)numBytes);
+}
+
 void SwapBytes(void *a, void *b, int numBytes)
 {
 	uint8_t *A = a;
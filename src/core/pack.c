@@ -0,0 +1,530 @@
+#include "../core.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// An asset pack is every asset file in the res folder glued together into one big file, so that loading assets doesn't
+// need a separate open/read for every file, or a directory listing for every sprite. On desktop we memory map
+// the whole pack, and on the web we read it in one go. The layout is:
+//
+//   PackHeader
+//   PackEntry[numEntries]    Sorted by (hash, path), so we can binary search for a path.
+//   char strings[]           0 terminated paths of all entries, relative to the res folder, with '/' separators.
+//   blobs                    File contents, every blob starts on a PACK_ALIGNMENT boundary.
+//
+// Directories get entries too. Their blob is a list of uint32_t entry indices of all files directly inside them,
+// sorted by path. Hot-reloading doesn't work for packed assets, so in dev mode we don't mount the pack at all.
+
+#if defined(_WIN32)
+	// Including windows.h clashes with raylib, so we declare the few functions we need ourselves.
+	__declspec(dllimport) void *__stdcall CreateFileA(const char *fileName, unsigned long access, unsigned long shareMode, void *security, unsigned long creation, unsigned long flags, void *templateFile);
+	__declspec(dllimport) void *__stdcall CreateFileMappingA(void *file, void *security, unsigned long protect, unsigned long maxSizeHigh, unsigned long maxSizeLow, const char *name);
+	__declspec(dllimport) void *__stdcall MapViewOfFile(void *mapping, unsigned long access, unsigned long offsetHigh, unsigned long offsetLow, size_t numBytes);
+	__declspec(dllimport) int __stdcall UnmapViewOfFile(const void *address);
+	__declspec(dllimport) int __stdcall GetFileSizeEx(void *file, long long *size);
+	__declspec(dllimport) int __stdcall CloseHandle(void *handle);
+#	define USE_WIN32_MAPPING
+#elif !defined(__EMSCRIPTEN__)
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#	define USE_MMAP
+#endif
+
+#define PACK_MAGIC 0x50545357 // "WSTP"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 4096
+
+STRUCT(PackHeader)
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numEntries;
+	uint32_t stringsSize;
+	uint64_t entriesOffset;
+	uint64_t stringsOffset;
+};
+
+STRUCT(PackEntry)
+{
+	uint32_t hash; // HashString(path).
+	uint32_t pathOffset; // Into the strings.
+	uint32_t isDirectory;
+	uint32_t padding;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static const unsigned char *pack;
+static long long packSize;
+static const PackHeader *header;
+static const PackEntry *entries;
+static const char *strings;
+#ifdef USE_WIN32_MAPPING
+static void *packFile;
+static void *packMapping;
+#endif
+
+// Paths can come from scene files written on any platform, so "./alex\\0.png" and "alex/0.png" need to find the same entry.
+static void NormalizePackPath(char *buffer, int capacity, const char *path)
+{
+	while (path[0] == '.' and (path[1] == '/' or path[1] == '\\'))
+		path += 2;
+	CopyString(buffer, path, capacity);
+	ReplaceChar(buffer, '\\', '/');
+
+	int length = StringLength(buffer);
+	while (length > 0 and buffer[length - 1] == '/')
+		buffer[--length] = 0;
+}
+static const PackEntry *FindPackEntry(const char *path)
+{
+	if (not pack or not path)
+		return NULL;
+
+	char normalized[512];
+	NormalizePackPath(normalized, sizeof normalized, path);
+	uint32_t hash = HashString(normalized);
+
+	// Find the first entry with this hash, and then look through all entries that share it.
+	int low = 0;
+	int high = (int)header->numEntries;
+	while (low < high)
+	{
+		int middle = low + (high - low) / 2;
+		if (entries[middle].hash < hash)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for (int i = low; i < (int)header->numEntries and entries[i].hash == hash; ++i)
+		if (StringsEqual(strings + entries[i].pathOffset, normalized))
+			return &entries[i];
+
+	return NULL;
+}
+static bool ValidatePack(void)
+{
+	if (packSize < (long long)sizeof(PackHeader))
+		return false;
+
+	header = (const PackHeader *)pack;
+	if (header->magic != PACK_MAGIC or header->version != PACK_VERSION)
+		return false;
+	if (header->entriesOffset + header->numEntries * sizeof(PackEntry) > (uint64_t)packSize)
+		return false;
+	if (header->stringsOffset + header->stringsSize > (uint64_t)packSize)
+		return false;
+
+	entries = (const PackEntry *)(pack + header->entriesOffset);
+	strings = (const char *)(pack + header->stringsOffset);
+	if (header->stringsSize == 0 or strings[header->stringsSize - 1] != 0)
+		return false;
+	for (uint32_t i = 0; i < header->numEntries; ++i)
+		if (entries[i].pathOffset >= header->stringsSize or entries[i].offset + entries[i].size > (uint64_t)packSize)
+			return false;
+
+	return true;
+}
+
+bool MountAssetPack(const char *path)
+{
+	UnmountAssetPack();
+
+	#if defined(USE_WIN32_MAPPING)
+	{
+		void *invalidHandle = (void *)(intptr_t)-1;
+		packFile = CreateFileA(path, 0x80000000 /* GENERIC_READ */, 1 /* FILE_SHARE_READ */, NULL, 3 /* OPEN_EXISTING */, 0x80 /* FILE_ATTRIBUTE_NORMAL */, NULL);
+		if (packFile == invalidHandle)
+		{
+			packFile = NULL;
+			return false;
+		}
+
+		GetFileSizeEx(packFile, &packSize);
+		packMapping = CreateFileMappingA(packFile, NULL, 2 /* PAGE_READONLY */, 0, 0, NULL);
+		if (packMapping)
+			pack = MapViewOfFile(packMapping, 4 /* FILE_MAP_READ */, 0, 0, 0);
+	}
+	#elif defined(USE_MMAP)
+	{
+		int file = open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat status;
+		if (fstat(file, &status) == 0 and status.st_size > 0)
+		{
+			packSize = (long long)status.st_size;
+			void *mapping = mmap(NULL, (size_t)packSize, PROT_READ, MAP_PRIVATE, file, 0);
+			if (mapping != MAP_FAILED)
+				pack = mapping;
+		}
+		close(file); // The mapping keeps the file alive.
+	}
+	#else
+	{
+		unsigned size = 0;
+		pack = LoadFileData(path, &size);
+		packSize = size;
+	}
+	#endif
+
+	if (not pack)
+	{
+		LogError("Couldn't map asset pack '%s'.", path);
+		UnmountAssetPack();
+		return false;
+	}
+	if (not ValidatePack())
+	{
+		LogError("Couldn't mount asset pack '%s' because it's corrupted, or from an older version of the game.", path);
+		UnmountAssetPack();
+		return false;
+	}
+
+	LogInfo("Mounted asset pack '%s' with %u entries.", path, header->numEntries);
+	return true;
+}
+
+void UnmountAssetPack(void)
+{
+	#if defined(USE_WIN32_MAPPING)
+	{
+		if (pack)
+			UnmapViewOfFile(pack);
+		if (packMapping)
+			CloseHandle(packMapping);
+		if (packFile)
+			CloseHandle(packFile);
+		packMapping = NULL;
+		packFile = NULL;
+	}
+	#elif defined(USE_MMAP)
+	{
+		if (pack)
+			munmap((void *)pack, (size_t)packSize);
+	}
+	#else
+	{
+		UnloadFileData((unsigned char *)pack);
+	}
+	#endif
+
+	pack = NULL;
+	packSize = 0;
+	header = NULL;
+	entries = NULL;
+	strings = NULL;
+}
+
+bool IsInAssetPack(const char *path)
+{
+	return FindPackEntry(path) != NULL;
+}
+
+const unsigned char *GetPackedFileData(const char *path, int *outSize)
+{
+	*outSize = 0;
+	const PackEntry *entry = FindPackEntry(path);
+	if (not entry or entry->isDirectory)
+		return NULL;
+
+	*outSize = (int)entry->size;
+	return pack + entry->offset;
+}
+
+int GetPackedDirectoryFileCount(const char *path)
+{
+	const PackEntry *entry = FindPackEntry(path);
+	if (not entry or not entry->isDirectory)
+		return -1;
+
+	return (int)(entry->size / sizeof(uint32_t));
+}
+
+const char *GetPackedDirectoryFilePath(const char *path, int index)
+{
+	int count = GetPackedDirectoryFileCount(path);
+	if (index < 0 or index >= count)
+		return NULL;
+
+	const PackEntry *entry = FindPackEntry(path);
+	const uint32_t *children = (const uint32_t *)(pack + entry->offset);
+	if (children[index] >= header->numEntries)
+		return NULL;
+
+	return strings + entries[children[index]].pathOffset;
+}
+
+bool AssetExists(const char *path)
+{
+	return IsInAssetPack(path) or FileExists(path);
+}
+
+Image LoadAssetImage(const char *path)
+{
+	int size;
+	const unsigned char *data = GetPackedFileData(path, &size);
+	if (data)
+		return LoadImageFromMemory(GetFileExtension(path), data, size);
+	return LoadImage(path);
+}
+
+Wave LoadAssetWave(const char *path)
+{
+	int size;
+	const unsigned char *data = GetPackedFileData(path, &size);
+	if (data)
+		return LoadWaveFromMemory(GetFileExtension(path), data, size);
+	return LoadWave(path);
+}
+
+unsigned char *LoadAssetData(const char *path, int *outSize)
+{
+	int size;
+	const unsigned char *data = GetPackedFileData(path, &size);
+	if (not data)
+	{
+		unsigned diskSize = 0;
+		unsigned char *result = LoadFileData(path, &diskSize);
+		*outSize = (int)diskSize;
+		return result;
+	}
+
+	unsigned char *result = MemAlloc(size);
+	CopyBytes(result, data, size);
+	*outSize = size;
+	return result;
+}
+
+char *LoadAssetText(const char *path)
+{
+	int size;
+	const unsigned char *data = GetPackedFileData(path, &size);
+	if (not data)
+		return LoadFileText(path);
+
+	char *text = MemAlloc(size + 1); // Zeroed, so it's 0 terminated.
+	CopyBytes(text, data, size);
+	return text;
+}
+
+//
+// Writing packs
+//
+
+STRUCT(PackItem)
+{
+	const char *path; // Normalized, relative to the packed directory.
+	const char *diskPath;
+	bool isDirectory;
+	uint32_t hash;
+	uint32_t pathOffset;
+	uint64_t offset;
+	uint64_t size;
+	List(uint32_t) children;
+};
+
+// Only the kinds of files the asset loaders actually read go in the pack. Anything else in the res folder is
+// tooling output (traces, half-written .tmp saves, the script cache) or per-user stuff that shouldn't ship.
+#define PACKED_FILE_EXTENSIONS ".png;.bmp;.tga;.jpg;.gif;.wav;.ogg;.mp3;.flac;.txt;.scene;.ttf"
+
+static bool ShouldPackFile(const char *path)
+{
+	// Hidden files and folders (.options, .scriptcache/...) at any depth.
+	for (const char *c = path; *c; ++c)
+		if (*c == '.' and (c == path or c[-1] == '/'))
+			return false;
+
+	// Lock files that office programs leave next to open documents, like "~$script.txt".
+	const char *name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+	if (name[0] == '~')
+		return false;
+
+	return IsFileExtension(path, PACKED_FILE_EXTENSIONS);
+}
+
+static int ComparePackItems(const void *a, const void *b)
+{
+	const PackItem *itemA = a;
+	const PackItem *itemB = b;
+	if (itemA->hash != itemB->hash)
+		return itemA->hash < itemB->hash ? -1 : +1;
+	return strcmp(itemA->path, itemB->path);
+}
+static List(PackItem) packItemsBeingSorted; // qsort doesn't let us pass this to the comparison function.
+static int ComparePackChildren(const void *a, const void *b)
+{
+	uint32_t indexA = *(const uint32_t *)a;
+	uint32_t indexB = *(const uint32_t *)b;
+	return strcmp(packItemsBeingSorted[indexA].path, packItemsBeingSorted[indexB].path);
+}
+static bool IsDirectChild(const char *directory, const char *path)
+{
+	int length = StringLength(directory);
+	if (strncmp(directory, path, length) != 0 or path[length] != '/')
+		return false;
+	return strchr(path + length + 1, '/') == NULL;
+}
+static uint64_t AlignPackOffset(uint64_t offset)
+{
+	return (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+}
+static void AddPackItem(List(PackItem) *items, const char *path, const char *diskPath, bool isDirectory)
+{
+	PackItem *item = ListAllocateItem(items);
+	ZeroBytes(item, sizeof item[0]);
+	item->path = path;
+	item->diskPath = diskPath;
+	item->isDirectory = isDirectory;
+	item->hash = HashString(path);
+	ListSetAllocator((void **)&item->children, TempRealloc, TempFree);
+}
+
+bool WriteAssetPack(const char *directory, const char *packPath)
+{
+	bool success = false;
+	int mark = TempMark();
+	{
+		char normalizedPackPath[512];
+		NormalizePackPath(normalizedPackPath, sizeof normalizedPackPath, packPath);
+
+		List(PackItem) items = NULL;
+		ListSetAllocator((void **)&items, TempRealloc, TempFree);
+
+		FilePathList files = LoadDirectoryFilesEx(directory, NULL, true);
+		for (unsigned i = 0; i < files.count; ++i)
+		{
+			const char *relative = files.paths[i] + StringLength(directory);
+			while (relative[0] == '/' or relative[0] == '\\')
+				++relative;
+
+			int capacity = StringLength(relative) + 1;
+			char *path = TempAlloc(capacity);
+			NormalizePackPath(path, capacity, relative);
+			if (not ShouldPackFile(path) or StringsEqual(path, normalizedPackPath))
+				continue;
+
+			AddPackItem(&items, path, TempString(files.paths[i]), false);
+
+			// Every directory on the way to the file needs an entry too.
+			char *parent = TempString(path);
+			for (char *slash = strrchr(parent, '/'); slash; slash = strrchr(parent, '/'))
+			{
+				*slash = 0;
+				bool isNew = true;
+				for (int j = 0; j < ListCount(items) and isNew; ++j)
+					if (items[j].isDirectory and StringsEqual(items[j].path, parent))
+						isNew = false;
+				if (not isNew)
+					break;
+
+				AddPackItem(&items, parent, NULL, true);
+				parent = TempString(parent);
+			}
+		}
+		UnloadDirectoryFiles(files);
+
+		int numItems = ListCount(items);
+		qsort(items, numItems, sizeof items[0], ComparePackItems);
+
+		// Directory listings refer to entries by their sorted index.
+		packItemsBeingSorted = items;
+		for (int i = 0; i < numItems; ++i)
+		{
+			if (not items[i].isDirectory)
+				continue;
+			for (int j = 0; j < numItems; ++j)
+				if (not items[j].isDirectory and IsDirectChild(items[i].path, items[j].path))
+					ListAdd(&items[i].children, (uint32_t)j);
+			qsort(items[i].children, ListCount(items[i].children), sizeof items[i].children[0], ComparePackChildren);
+		}
+		packItemsBeingSorted = NULL;
+
+		// Lay everything out.
+		uint32_t stringsSize = 0;
+		for (int i = 0; i < numItems; ++i)
+		{
+			items[i].pathOffset = stringsSize;
+			stringsSize += StringLength(items[i].path) + 1;
+		}
+
+		PackHeader packHeader = { 0 };
+		packHeader.magic = PACK_MAGIC;
+		packHeader.version = PACK_VERSION;
+		packHeader.numEntries = numItems;
+		packHeader.stringsSize = stringsSize;
+		packHeader.entriesOffset = sizeof packHeader;
+		packHeader.stringsOffset = packHeader.entriesOffset + numItems * sizeof(PackEntry);
+
+		uint64_t offset = packHeader.stringsOffset + stringsSize;
+		for (int i = 0; i < numItems; ++i)
+		{
+			offset = AlignPackOffset(offset);
+			items[i].offset = offset;
+			if (items[i].isDirectory)
+				items[i].size = ListCount(items[i].children) * sizeof(uint32_t);
+			else
+				items[i].size = GetFileLength(items[i].diskPath);
+			offset += items[i].size;
+		}
+
+		FILE *file = fopen(packPath, "wb");
+		if (not file)
+			LogError("Couldn't write asset pack '%s' because the file couldn't be opened.", packPath);
+		else
+		{
+			success = true;
+			fwrite(&packHeader, sizeof packHeader, 1, file);
+			for (int i = 0; i < numItems; ++i)
+			{
+				PackEntry entry = { 0 };
+				entry.hash = items[i].hash;
+				entry.pathOffset = items[i].pathOffset;
+				entry.isDirectory = items[i].isDirectory;
+				entry.offset = items[i].offset;
+				entry.size = items[i].size;
+				fwrite(&entry, sizeof entry, 1, file);
+			}
+			for (int i = 0; i < numItems; ++i)
+				fwrite(items[i].path, StringLength(items[i].path) + 1, 1, file);
+
+			static const unsigned char zeros[PACK_ALIGNMENT];
+			for (int i = 0; i < numItems and success; ++i)
+			{
+				long position = ftell(file);
+				fwrite(zeros, (size_t)(items[i].offset - position), 1, file);
+
+				if (items[i].isDirectory)
+					fwrite(items[i].children, (size_t)items[i].size, 1, file);
+				else
+				{
+					unsigned size = 0;
+					unsigned char *data = LoadFileData(items[i].diskPath, &size);
+					if (size != items[i].size)
+					{
+						LogError("Couldn't write asset pack '%s' because '%s' changed while packing.", packPath, items[i].diskPath);
+						success = false;
+					}
+					else fwrite(data, size, 1, file);
+					UnloadFileData(data);
+				}
+			}
+
+			if (ferror(file))
+			{
+				LogError("Couldn't write asset pack '%s'.", packPath);
+				success = false;
+			}
+			fclose(file);
+			if (success)
+				LogInfo("Wrote %d entries to asset pack '%s' (%lld bytes).", numItems, packPath, (long long)offset);
+		}
+	}
+	TempReset(mark);
+	return success;
+}
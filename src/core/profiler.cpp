@@ -0,0 +1,598 @@
+#include "../core.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef __EMSCRIPTEN__
+#	include <thread>
+#endif
+
+// Every thread that enters a zone gets its own ring buffer of finished zones, so recording never takes a lock.
+// The main thread marks where frames start, and the profiler window groups zones by frame using those timestamps.
+// The ring buffers are read while other threads might be writing to them, so the very oldest zones in a buffer
+// can be garbage. We only ever look at the last PROFILER_NUM_FRAMES frames, which is far away from that.
+//
+// Traces are written by a background thread that wakes up every few milliseconds and copies whatever new zones
+// showed up in the ring buffers into the trace file. Frame markers and counters come from the main thread only,
+// and they are rare, so they just go into a locked list. The file is in the Chrome Trace Event format, which
+// both chrome://tracing and https://ui.perfetto.dev can open.
+
+#define PROFILER_NUM_EVENTS 65536 // Per thread, must be a power of 2.
+#define PROFILER_NUM_FRAMES 240 // How many frames of history the profiler window shows.
+#define PROFILER_MAX_DEPTH 32
+#define PROFILER_MAX_ZONES 128 // Distinct zone names in the statistics table.
+#define TRACE_TEMP_PATH "trace_in_progress.json" // Where the trace goes until we know its real name.
+#define TRACE_FLUSH_INTERVAL 10 // Milliseconds between writes, has to be well below how long it takes to fill half a ring buffer.
+
+STRUCT(ProfileEvent)
+{
+	const char *name;
+	uint64_t start; // Nanoseconds.
+	uint64_t end;
+	int depth;
+};
+
+STRUCT(ThreadProfile)
+{
+	int index;
+	int depth;
+	bool isMainThread;
+	ProfileEvent stack[PROFILER_MAX_DEPTH];
+	ProfileEvent events[PROFILER_NUM_EVENTS];
+	std::atomic<uint32_t> numEvents; // Total ever written, the ring index is this modulo PROFILER_NUM_EVENTS.
+	uint32_t numTracedEvents; // How far into the ring buffer the trace writer got. Only touched by the trace writer.
+};
+
+ENUM(TraceRecordKind)
+{
+	TRACE_FRAME,
+	TRACE_COUNTER,
+};
+
+STRUCT(TraceRecord)
+{
+	TraceRecordKind kind;
+	const char *name;
+	uint64_t time;
+	double value;
+};
+
+STRUCT(ZoneStats)
+{
+	const char *name;
+	double frameTimes[PROFILER_NUM_FRAMES]; // Total time spent in the zone in each frame, in milliseconds.
+};
+
+static std::mutex threadsMutex;
+static List(ThreadProfile *) threads;
+static thread_local ThreadProfile *thisThread;
+static uint64_t frameStarts[PROFILER_NUM_FRAMES];
+static int numFrames; // Total ever started, the ring index is this modulo PROFILER_NUM_FRAMES.
+static bool isGuiOpen;
+static bool isPaused;
+static int selectedFrame; // How many frames back from the newest complete frame.
+
+static std::mutex traceMutex;
+static std::condition_variable traceWakeUp;
+static List(TraceRecord) traceRecords; // Frame markers and counters waiting to be written.
+static std::atomic<bool> isTracing;
+static bool stopTracing;
+static FILE *traceFile;
+static uint64_t traceStart;
+static int numTraceEventsWritten;
+static int numTraceEventsDropped;
+#ifndef __EMSCRIPTEN__
+static std::thread traceWriter;
+#endif
+
+static uint64_t GetProfilerTime(void)
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+static ThreadProfile *GetThreadProfile(void)
+{
+	if (not thisThread)
+	{
+		// Never freed, our threads live until the program exits.
+		thisThread = new ThreadProfile();
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		thisThread->index = ListCount(threads);
+		ListAdd(&threads, thisThread);
+	}
+	return thisThread;
+}
+static double ToMilliseconds(uint64_t nanoseconds)
+{
+	return 1e-6 * (double)nanoseconds;
+}
+static ImU32 GetZoneColor(const char *name)
+{
+	// Same name, same color, so zones are easy to follow from frame to frame.
+	unsigned hash = HashString(name);
+	float hue = (hash % 360) / 360.0f;
+	ImVec4 color;
+	ImGui::ColorConvertHSVtoRGB(hue, 0.5f, 0.8f, color.x, color.y, color.z);
+	color.w = 1;
+	return ImGui::GetColorU32(color);
+}
+static int CompareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+// Returns which frame a timestamp is in, counting back from the newest complete frame, or -1 if it's in none of them.
+static int FindFrame(uint64_t time, int numCompleteFrames)
+{
+	// Frames are sorted by time, so binary search for the last one that started before the timestamp.
+	int oldest = numFrames - 1 - numCompleteFrames;
+	int low = 0;
+	int high = numCompleteFrames;
+	while (low < high)
+	{
+		int middle = low + (high - low) / 2;
+		if (frameStarts[(oldest + middle) % PROFILER_NUM_FRAMES] <= time)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	int frame = low - 1;
+	if (frame < 0)
+		return -1;
+	if (time >= frameStarts[(oldest + frame + 1) % PROFILER_NUM_FRAMES])
+		return -1; // In the frame that's still going.
+	return numCompleteFrames - 1 - frame;
+}
+
+static void WriteTraceEvent(FILE *file, const char *format, ...)
+{
+	if (numTraceEventsWritten > 0)
+		fputs(",\n", file);
+	++numTraceEventsWritten;
+
+	va_list args;
+	va_start(args, format);
+	vfprintf(file, format, args);
+	va_end(args);
+}
+// Chrome traces want microseconds.
+static double ToTraceTime(uint64_t time)
+{
+	return 1e-3 * (double)(time - traceStart);
+}
+// Writes out everything that was recorded since the last time this was called.
+static void FlushTrace(void)
+{
+	List(ThreadProfile *) threadsCopy = NULL;
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		for (int i = 0; i < ListCount(threads); ++i)
+			ListAdd(&threadsCopy, threads[i]);
+	}
+
+	for (int t = 0; t < ListCount(threadsCopy); ++t)
+	{
+		ThreadProfile *thread = threadsCopy[t];
+		uint32_t count = thread->numEvents.load(std::memory_order_acquire);
+
+		// The thread might be writing over the oldest zones in its ring buffer right now, so stay well clear of those.
+		if (count - thread->numTracedEvents > PROFILER_NUM_EVENTS / 2)
+		{
+			uint32_t skipTo = count - PROFILER_NUM_EVENTS / 2;
+			numTraceEventsDropped += (int)(skipTo - thread->numTracedEvents);
+			thread->numTracedEvents = skipTo;
+		}
+
+		for (uint32_t i = thread->numTracedEvents; i < count; ++i)
+		{
+			ProfileEvent event = thread->events[i % PROFILER_NUM_EVENTS];
+			if (event.start < traceStart)
+				continue; // Started before the trace did.
+
+			WriteTraceEvent(traceFile, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				event.name, thread->index, ToTraceTime(event.start), 1e-3 * (double)(event.end - event.start));
+		}
+		thread->numTracedEvents = count;
+	}
+	ListDestroy((void **)&threadsCopy);
+
+	List(TraceRecord) records = NULL;
+	{
+		std::lock_guard<std::mutex> lock(traceMutex);
+		records = traceRecords;
+		traceRecords = NULL;
+	}
+	for (int i = 0; i < ListCount(records); ++i)
+	{
+		TraceRecord record = records[i];
+		switch (record.kind)
+		{
+			case TRACE_FRAME:
+				WriteTraceEvent(traceFile, "{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":%.3f}",
+					ToTraceTime(record.time));
+				break;
+			case TRACE_COUNTER:
+				WriteTraceEvent(traceFile, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"ts\":%.3f,\"args\":{\"value\":%g}}",
+					record.name, ToTraceTime(record.time), record.value);
+				break;
+		}
+	}
+	ListDestroy((void **)&records);
+}
+#ifndef __EMSCRIPTEN__
+static void RunTraceWriter(void)
+{
+	std::unique_lock<std::mutex> lock(traceMutex);
+	while (not stopTracing)
+	{
+		traceWakeUp.wait_for(lock, std::chrono::milliseconds(TRACE_FLUSH_INTERVAL));
+		lock.unlock();
+		FlushTrace();
+		lock.lock();
+	}
+}
+#endif
+
+extern "C"
+{
+	void ProfileBegin(const char *name)
+	{
+		ThreadProfile *thread = GetThreadProfile();
+		if (thread->depth < PROFILER_MAX_DEPTH)
+		{
+			ProfileEvent *event = &thread->stack[thread->depth];
+			event->name = name;
+			event->depth = thread->depth;
+			event->start = GetProfilerTime();
+		}
+		++thread->depth;
+	}
+
+	void ProfileEnd(void)
+	{
+		ThreadProfile *thread = GetThreadProfile();
+		ASSERT(thread->depth > 0); // More PROFILE_ENDs than PROFILE_BEGINs!
+		--thread->depth;
+		if (thread->depth >= PROFILER_MAX_DEPTH)
+			return;
+
+		ProfileEvent event = thread->stack[thread->depth];
+		event.end = GetProfilerTime();
+		uint32_t index = thread->numEvents.load(std::memory_order_relaxed);
+		thread->events[index % PROFILER_NUM_EVENTS] = event;
+		thread->numEvents.store(index + 1, std::memory_order_release);
+	}
+
+	void ProfileFrame(void)
+	{
+		GetThreadProfile()->isMainThread = true; // Also makes sure the main thread is first in the list, if we're called early enough.
+		if (isTracing)
+		{
+			TraceRecord record = { TRACE_FRAME };
+			record.time = GetProfilerTime();
+			std::lock_guard<std::mutex> lock(traceMutex);
+			ListAdd(&traceRecords, record);
+		}
+
+		if (isPaused)
+			return;
+
+		frameStarts[numFrames % PROFILER_NUM_FRAMES] = GetProfilerTime();
+		++numFrames;
+	}
+
+	void ProfileCounter(const char *name, double value)
+	{
+		if (not isTracing)
+			return;
+
+		TraceRecord record = { TRACE_COUNTER };
+		record.name = name;
+		record.time = GetProfilerTime();
+		record.value = value;
+		std::lock_guard<std::mutex> lock(traceMutex);
+		ListAdd(&traceRecords, record);
+	}
+
+	bool StartTrace(void)
+	{
+		#ifdef __EMSCRIPTEN__
+		{
+			LogError("Tracing isn't supported on the web.");
+			return false;
+		}
+		#else
+		{
+			if (isTracing)
+			{
+				LogError("Already tracing, stop the current trace first.");
+				return false;
+			}
+
+			traceFile = fopen(TRACE_TEMP_PATH, "wb");
+			if (not traceFile)
+			{
+				LogError("Couldn't open '%s' for writing.", TRACE_TEMP_PATH);
+				return false;
+			}
+			fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", traceFile);
+
+			traceStart = GetProfilerTime();
+			numTraceEventsWritten = 0;
+			numTraceEventsDropped = 0;
+			{
+				// Zones that finished before now don't belong in the trace.
+				std::lock_guard<std::mutex> lock(threadsMutex);
+				for (int i = 0; i < ListCount(threads); ++i)
+					threads[i]->numTracedEvents = threads[i]->numEvents.load(std::memory_order_acquire);
+			}
+			{
+				std::lock_guard<std::mutex> lock(traceMutex);
+				ListClear(&traceRecords);
+				stopTracing = false;
+			}
+
+			isTracing = true;
+			traceWriter = std::thread(RunTraceWriter);
+			LogInfo("Started tracing.");
+			return true;
+		}
+		#endif
+	}
+
+	bool StopTrace(const char *path)
+	{
+		if (not isTracing)
+		{
+			LogError("Not tracing, start a trace first.");
+			return false;
+		}
+
+		#ifndef __EMSCRIPTEN__
+		{
+			isTracing = false;
+			{
+				std::lock_guard<std::mutex> lock(traceMutex);
+				stopTracing = true;
+			}
+			traceWakeUp.notify_one();
+			traceWriter.join();
+		}
+		#endif
+
+		// The writer might have gone to sleep right before the last few zones came in.
+		FlushTrace();
+
+		// Name the threads so they're easier to tell apart.
+		{
+			std::lock_guard<std::mutex> lock(threadsMutex);
+			for (int i = 0; i < ListCount(threads); ++i)
+				WriteTraceEvent(traceFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+					i, threads[i]->isMainThread ? "Main thread" : "Worker", i);
+		}
+		fputs("\n]}\n", traceFile);
+		fclose(traceFile);
+		traceFile = NULL;
+
+		if (numTraceEventsDropped > 0)
+			LogWarning("The trace writer fell behind and dropped %d zones.", numTraceEventsDropped);
+
+		// On Windows, rename fails if the destination already exists.
+		remove(path);
+		if (rename(TRACE_TEMP_PATH, path) != 0)
+		{
+			LogError("Couldn't move the trace to '%s', it's still in '%s'.", path, TRACE_TEMP_PATH);
+			return false;
+		}
+
+		LogInfo("Wrote %d trace events to '%s'.", numTraceEventsWritten, path);
+		return true;
+	}
+
+	bool IsTracing(void)
+	{
+		return isTracing;
+	}
+
+	bool IsProfilerGuiOpen(void)
+	{
+		return isGuiOpen;
+	}
+
+	void SetProfilerGuiOpen(bool open)
+	{
+		isGuiOpen = open;
+	}
+
+	void ShowProfilerGui(void)
+	{
+		if (not isGuiOpen)
+			return;
+
+		ImGui::SetNextWindowSize(ImVec2(800, 500), ImGuiCond_FirstUseEver);
+		if (not ImGui::Begin("Profiler", &isGuiOpen))
+		{
+			ImGui::End();
+			return;
+		}
+
+		int numCompleteFrames = numFrames - 1;
+		if (numCompleteFrames > PROFILER_NUM_FRAMES - 1)
+			numCompleteFrames = PROFILER_NUM_FRAMES - 1;
+		if (numCompleteFrames <= 0)
+		{
+			ImGui::TextUnformatted("No frames recorded yet.");
+			ImGui::End();
+			return;
+		}
+
+		int mark = TempMark();
+
+		// Frame times, oldest first.
+		float *frameTimes = (float *)TempAlloc(numCompleteFrames * sizeof frameTimes[0]);
+		for (int i = 0; i < numCompleteFrames; ++i)
+		{
+			int frame = numFrames - 1 - numCompleteFrames + i;
+			uint64_t start = frameStarts[frame % PROFILER_NUM_FRAMES];
+			uint64_t end = frameStarts[(frame + 1) % PROFILER_NUM_FRAMES];
+			frameTimes[i] = (float)ToMilliseconds(end - start);
+		}
+
+		ImGui::Checkbox("Paused", &isPaused);
+		ImGui::SameLine();
+		selectedFrame = ClampInt(selectedFrame, 0, numCompleteFrames - 1);
+		ImGui::SliderInt("Frames back", &selectedFrame, 0, numCompleteFrames - 1);
+		ImGui::PlotHistogram("##Frame times", frameTimes, numCompleteFrames, 0, "Frame time (ms)", 0, 2 * 1000 * FRAME_TIME, ImVec2(-1, 60));
+
+		// Go through all zones we still have, collect statistics, and remember the ones in the selected frame.
+		List(ZoneStats) zones = NULL;
+		ListSetAllocator((void **)&zones, TempRealloc, TempFree);
+		List(ProfileEvent) selectedEvents = NULL;
+		ListSetAllocator((void **)&selectedEvents, TempRealloc, TempFree);
+		List(int) selectedThreads = NULL;
+		ListSetAllocator((void **)&selectedThreads, TempRealloc, TempFree);
+
+		int numThreads;
+		ThreadProfile **threadsCopy;
+		{
+			std::lock_guard<std::mutex> lock(threadsMutex);
+			numThreads = ListCount(threads);
+			threadsCopy = (ThreadProfile **)TempCopy(threads, numThreads * sizeof threads[0]);
+		}
+
+		for (int t = 0; t < numThreads; ++t)
+		{
+			ThreadProfile *thread = threadsCopy[t];
+			uint32_t count = thread->numEvents.load(std::memory_order_acquire);
+			uint32_t first = count > PROFILER_NUM_EVENTS / 2 ? count - PROFILER_NUM_EVENTS / 2 : 0;
+			for (uint32_t i = first; i < count; ++i)
+			{
+				ProfileEvent event = thread->events[i % PROFILER_NUM_EVENTS];
+				int frame = FindFrame(event.start, numCompleteFrames);
+				if (frame < 0)
+					continue;
+
+				ZoneStats *stats = NULL;
+				for (int z = 0; z < ListCount(zones) and not stats; ++z)
+					if (zones[z].name == event.name or StringsEqual(zones[z].name, event.name))
+						stats = &zones[z];
+				if (not stats and ListCount(zones) < PROFILER_MAX_ZONES)
+				{
+					stats = ListAllocateItem(&zones);
+					ZeroBytes(stats, sizeof stats[0]);
+					stats->name = event.name;
+				}
+				if (stats)
+					stats->frameTimes[frame] += ToMilliseconds(event.end - event.start);
+
+				if (frame == selectedFrame)
+				{
+					ListAdd(&selectedEvents, event);
+					ListAdd(&selectedThreads, t);
+				}
+			}
+		}
+
+		// Timeline of the selected frame, one band per thread, nested zones stacked below their parents.
+		{
+			int frame = numFrames - 2 - selectedFrame;
+			uint64_t frameStart = frameStarts[frame % PROFILER_NUM_FRAMES];
+			uint64_t frameEnd = frameStarts[(frame + 1) % PROFILER_NUM_FRAMES];
+			double frameDuration = (double)(frameEnd - frameStart);
+			ImGui::Text("Frame took %.3f ms", ToMilliseconds(frameEnd - frameStart));
+
+			int maxDepth = 0;
+			for (int i = 0; i < ListCount(selectedEvents); ++i)
+				if (maxDepth < selectedEvents[i].depth + 1)
+					maxDepth = selectedEvents[i].depth + 1;
+
+			float rowHeight = ImGui::GetTextLineHeight() + 4;
+			float bandHeight = rowHeight * (maxDepth > 0 ? maxDepth : 1) + 6;
+			ImVec2 origin = ImGui::GetCursorScreenPos();
+			float width = ImGui::GetContentRegionAvail().x;
+			ImGui::InvisibleButton("Timeline", ImVec2(width, bandHeight * numThreads));
+
+			ImDrawList *drawList = ImGui::GetWindowDrawList();
+			for (int t = 0; t < numThreads; ++t)
+			{
+				ImVec2 bandMin = ImVec2(origin.x, origin.y + t * bandHeight);
+				ImVec2 bandMax = ImVec2(origin.x + width, bandMin.y + bandHeight - 2);
+				drawList->AddRectFilled(bandMin, bandMax, ImGui::GetColorU32(ImGuiCol_FrameBg));
+			}
+
+			const ProfileEvent *hovered = NULL;
+			for (int i = 0; i < ListCount(selectedEvents); ++i)
+			{
+				ProfileEvent event = selectedEvents[i];
+				uint64_t end = event.end < frameEnd ? event.end : frameEnd;
+				float x0 = origin.x + width * (float)((event.start - frameStart) / frameDuration);
+				float x1 = origin.x + width * (float)((end - frameStart) / frameDuration);
+				if (x1 < x0 + 1)
+					x1 = x0 + 1;
+				float y0 = origin.y + selectedThreads[i] * bandHeight + event.depth * rowHeight;
+				ImVec2 min = ImVec2(x0, y0);
+				ImVec2 max = ImVec2(x1, y0 + rowHeight - 1);
+
+				drawList->AddRectFilled(min, max, GetZoneColor(event.name));
+				if (x1 - x0 > ImGui::CalcTextSize(event.name).x + 4)
+				{
+					drawList->PushClipRect(min, max, true);
+					drawList->AddText(ImVec2(x0 + 2, y0 + 2), IM_COL32_BLACK, event.name);
+					drawList->PopClipRect();
+				}
+				if (ImGui::IsMouseHoveringRect(min, max))
+					hovered = &selectedEvents[i];
+			}
+
+			if (hovered)
+			{
+				ImGui::BeginTooltip();
+				ImGui::Text("%s: %.3f ms", hovered->name, ToMilliseconds(hovered->end - hovered->start));
+				ImGui::EndTooltip();
+			}
+		}
+
+		// Statistics over all the frames we have.
+		if (ImGui::BeginTable("Zones", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Zone");
+			ImGui::TableSetupColumn("Min (ms)");
+			ImGui::TableSetupColumn("Avg (ms)");
+			ImGui::TableSetupColumn("p99 (ms)");
+			ImGui::TableHeadersRow();
+
+			double *sorted = (double *)TempAlloc(numCompleteFrames * sizeof sorted[0]);
+			for (int z = 0; z < ListCount(zones); ++z)
+			{
+				CopyBytes(sorted, zones[z].frameTimes, numCompleteFrames * sizeof sorted[0]);
+				qsort(sorted, numCompleteFrames, sizeof sorted[0], CompareDoubles);
+
+				double sum = 0;
+				for (int i = 0; i < numCompleteFrames; ++i)
+					sum += sorted[i];
+				int p99 = ClampInt((int)ceil(0.99 * numCompleteFrames) - 1, 0, numCompleteFrames - 1);
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(zones[z].name);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", sorted[0]);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", sum / numCompleteFrames);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.3f", sorted[p99]);
+			}
+			ImGui::EndTable();
+		}
+
+		TempReset(mark);
+		ImGui::End();
+	}
+}
@@ -8,7 +8,7 @@ Random TimeSeededRandom(void)
 		uint64_t i;
 	} floatInt;
 	
-	floatInt.f = GetTime();
+	floatInt.f = GetSteadyTime();
 	uint64_t x = floatInt.i;
 
 	unsigned seed = (unsigned)x ^ (unsigned)(x >> 32);
@@ -1,6 +1,9 @@
 #include "../core.h"
 #include "../lib/imgui/imgui_impl_raylib.h"
 
+#include <chrono>
+#include <stdlib.h>
+
 #ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
 #endif
@@ -12,9 +15,135 @@ extern "C" __declspec(dllexport) unsigned long NvOptimusEnablement = 1;
 extern "C" __declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
 #endif
 
+// How much of each frame we're willing to spend uploading assets that finished loading in the background.
+#define JOB_COMPLETION_BUDGET 0.004
+
+static void ChangeToResDirectory(void)
+{
+	// We need the 'res' folder to be accessible from the working directory before we do anything. 
+	// But, on desktop we have no clue where the working directory or the app will be when we run. 
+	// I mean, we do actually know, but it's different on mac/windows/linux, and I don't want to
+	// hardcode it because it might change. So we just programmatically find it at runtime.
+	// On web builds, we know for sure that 'res' is in the working directory, so we don't have
+	// to do this dance and we can save a few instructions and startup time.
+	#ifndef __EMSCRIPTEN__
+	{
+		ChangeDirectory(GetApplicationDirectory());
+		while (not DirectoryExists("res"))
+		{
+			char *newDir = TempFormat("%s/..", GetWorkingDirectory());
+			ChangeDirectory(newDir);
+			TempFree(newDir);
+		}
+	}
+	#endif
+	ChangeDirectory("res");
+}
+
+double GetSteadyTime(void)
+{
+	static const auto startTime = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Counters that show up in traces, see StartTrace.
+static void RecordFrameCounters(void)
+{
+	if (not IsTracing())
+		return;
+
+	PROFILE_COUNTER("Assets", GetNumAssets());
+	PROFILE_COUNTER("Asset cache (KB)", GetAssetCacheBytes() / 1024.0);
+	PROFILE_COUNTER("Temp memory high-water mark (KB)", GetTempHighWaterMark() / 1024.0);
+
+	#ifndef HEADLESS
+	{
+		// Raylib doesn't tell us how many draw calls it makes, but our ImGui backend does.
+		PROFILE_COUNTER("ImGui draw calls", ImGui_ImplRaylib_GetRenderStats().DrawCalls);
+	}
+	#endif
+}
+
+#ifdef HEADLESS
+
+// Simulates a scene without rendering anything, as fast as the CPU allows.
+// Usage: WhoStoleTheSun_headless [scene] [frames] [trace]
+// The scene path is relative to the 'res' folder, just like with the 'load' command.
+// If a trace path is given, the whole run is recorded into a Chrome trace file there (see StartTrace).
+int main(int argc, char **argv)
+{
+	ChangeToResDirectory();
+
+	const char *scene = argc > 1 ? argv[1] : NULL;
+	int numFrames = argc > 2 ? atoi(argv[2]) : 10 * FPS;
+	if (numFrames <= 0)
+		numFrames = 10 * FPS;
+	const char *trace = argc > 3 ? argv[3] : NULL;
+
+	GameInit();
+
+	// The game calls ImGui from its update functions, so it needs a context even though nothing is ever drawn.
+	// Building the font atlas is enough for NewFrame, there's no GPU to upload it to.
+	ImGui::CreateContext();
+	{
+		ImGuiIO &io = ImGui::GetIO();
+		io.IniFilename = NULL; // Don't overwrite the window layout of the real game.
+		io.DisplaySize = ImVec2(1280, 720);
+		io.DeltaTime = FRAME_TIME;
+		unsigned char *pixels;
+		int width, height;
+		io.Fonts->GetTexDataAsAlpha8(&pixels, &width, &height);
+	}
+
+	if (scene)
+		ExecuteCommand(TempFormat("load %s", scene));
+
+	// We only want to measure the simulation, so let the scene finish loading first.
+	WaitForAllJobs();
+
+	if (trace)
+		StartTrace();
+
+	double startTime = GetSteadyTime();
+	for (int i = 0; i < numFrames; ++i)
+	{
+		PROFILE_FRAME();
+		PROFILE_BEGIN("Assets");
+		UpdateJobs(JOB_COMPLETION_BUDGET);
+		PROFILE_END();
+		RecordFrameCounters();
+		TempReset(0);
+		ImGui::NewFrame();
+		PROFILE_BEGIN("Update");
+		UpdateCurrentGameState();
+		PROFILE_END();
+		ImGui::EndFrame();
+		PROFILE_BEGIN("Sounds");
+		UpdateTemporarySounds();
+		PROFILE_END();
+	}
+	double seconds = GetSteadyTime() - startTime;
+
+	if (trace and IsTracing())
+		StopTrace(trace);
+
+	LogInfo("Simulated %d frames in %.3f s (%.4f ms per frame, %.1fx realtime).",
+		numFrames, seconds, 1000 * seconds / numFrames, numFrames * FRAME_TIME / seconds);
+
+	ShutdownJobs();
+	ImGui::DestroyContext();
+	return 0;
+}
+
+#else
+
 static void DoOneFrame()
 {
+	PROFILE_FRAME();
+	PROFILE_BEGIN("Assets");
 	UpdateAllChangedAssets();
+	UpdateJobs(JOB_COMPLETION_BUDGET);
+	PROFILE_END();
 	TempReset(0);
 	BeginDrawing();
 	UpdateInputMappings();
@@ -22,36 +151,33 @@ static void DoOneFrame()
 	ImGui::NewFrame();
 	rlDisableBackfaceCulling();
 	{
+		PROFILE_BEGIN("Update");
 		UpdateCurrentGameState();
+		PROFILE_END();
+		PROFILE_BEGIN("Render");
 		RenderCurrentGameState();
+		rlDrawRenderBatchActive(); // So the game's draws are counted here, and not in the ImGui zone.
+		PROFILE_END();
 	}
-	rlDrawRenderBatchActive();
+	PROFILE_BEGIN("Profiler GUI");
+	ShowProfilerGui();
+	PROFILE_END();
+	PROFILE_BEGIN("ImGui");
 	ImGui::Render();
 	ImGui_ImplRaylib_Render(ImGui::GetDrawData());
+	PROFILE_END();
+	PROFILE_BEGIN("Present"); // Includes waiting for vsync or the frame limiter.
 	EndDrawing();
+	PROFILE_END();
+	RecordFrameCounters();
+	PROFILE_BEGIN("Sounds");
 	UpdateTemporarySounds();
+	PROFILE_END();
 }
 
 int main()
 {
-	// We need the 'res' folder to be accessible from the working directory before we do anything. 
-	// But, on desktop we have no clue where the working directory or the app will be when we run. 
-	// I mean, we do actually know, but it's different on mac/windows/linux, and I don't want to
-	// hardcode it because it might change. So we just programmatically find it at runtime.
-	// On web builds, we know for sure that 'res' is in the working directory, so we don't have
-	// to do this dance and we can save a few instructions and startup time.
-	#ifndef __EMSCRIPTEN__
-	{
-		ChangeDirectory(GetApplicationDirectory());
-		while (not DirectoryExists("res"))
-		{
-			char *newDir = TempFormat("%s/..", GetWorkingDirectory());
-			ChangeDirectory(newDir);
-			TempFree(newDir);
-		}
-	}
-	#endif
-	ChangeDirectory("res");
+	ChangeToResDirectory();
 
 	GameInit();
 	rlDisableBackfaceCulling(); // It's a 2D game we don't need this..
@@ -61,8 +187,19 @@ int main()
 	ImGui::StyleColorsDark();
 	ImGui_ImplRaylib_Init();
 	auto &io = ImGui::GetIO();
-	io.Fonts->AddFontFromFileTTF("roboto.ttf", 18);
-	ImGui_ImplRaylib_LoadDefaultFontAtlas();
+	{
+		// The font can come from the asset pack. ImGui keeps the font data around, so it gets its own copy.
+		int fontSize = 0;
+		unsigned char *fontData = LoadAssetData("roboto.ttf", &fontSize);
+		if (fontData)
+		{
+			void *imguiFontData = IM_ALLOC(fontSize);
+			CopyBytes(imguiFontData, fontData, fontSize);
+			io.Fonts->AddFontFromMemoryTTF(imguiFontData, fontSize, 18);
+			UnloadFileData(fontData);
+		}
+		ImGui_ImplRaylib_LoadDefaultFontAtlas();
+	}
 
 	// On the web, the browser wants to drive the main loop. On other platforms, we drive it.
 	// See: https://emscripten.org/docs/porting/emscripten-runtime-environment.html#browser-main-loop
@@ -74,14 +211,19 @@ int main()
 	{
 		while (not WindowShouldClose())
 			DoOneFrame();
+		if (IsTracing())
+			StopTrace("trace.json"); // Don't lose a trace just because someone forgot to stop it.
+		WaitForAllJobs();
 		GameDeinit();
 	}
 	#endif
 }
 
+#endif // HEADLESS
+
 
 // On Windows, when running without the command line, the program entry point is WinMain instead of main.
-#ifdef _WIN32
+#if defined(_WIN32) && !defined(HEADLESS)
 int __stdcall WinMain(void *instance, void *prevInstance, char *cmdLine, int showCmd)
 {
 	UNUSED(instance); UNUSED(prevInstance); UNUSED(cmdLine); UNUSED(showCmd);
@@ -8,6 +8,11 @@
 #define CONTROL(codepoint) -codepoint
 #define IS_CONTROL(codepoint) (codepoint < 0)
 
+// Parsed scripts are cached here, so we don't have to parse them again next time. Starts with a dot, so it never goes into the asset pack.
+#define SCRIPT_CACHE_DIRECTORY ".scriptcache"
+#define SCRIPT_CACHE_MAGIC "SCRC"
+#define SCRIPT_CACHE_VERSION 1 // You need to increase this every time the cache format, or the parsing rules, change!
+
 ENUM(Style)
 {
 	REGULAR     = 0,
@@ -24,18 +29,62 @@ STRUCT(Word)
 	float width;
 };
 
-static float GetAdvance(Font font, float fontSize, int glyphIndex)
+// A paragraph without pointers, so it can go straight into a cache file. The arrays of all paragraphs are stored one after another.
+STRUCT(ParagraphHeader)
+{
+	int speaker; // Index into the string pool, or -1 for the default speaker.
+	float duration;
+	int initialExpression;
+	int numCodepoints;
+	int numExpressionChanges;
+	int numCommands;
+};
+
+// A command without its handler and arguments, those are looked up again every time the script loads.
+STRUCT(CommandHeader)
+{
+	int stringIndex;
+	float time;
+};
+
+// Everything in a script except for its fonts, as flat arrays. Either straight from a cache file, or from the parser.
+STRUCT(ScriptImage)
 {
-	float scaleFactor = fontSize / font.baseSize;
-	if (font.glyphs[glyphIndex].advanceX == 0)
-		return scaleFactor * font.recs[glyphIndex].width;
-	else
-		return scaleFactor * font.glyphs[glyphIndex].advanceX;
+	int numParagraphs;
+	const ParagraphHeader *paragraphs;
+	int numCodepoints;
+	const int *codepoints;
+	int numExpressionChanges;
+	const ExpressionChange *expressionChanges;
+	int numCommands;
+	const CommandHeader *commands;
+	int stringPoolSize;
+	const char *stringPool;
+};
+
+// Returns the index of the string in the pool. Each string is only stored once, no matter how many times it comes up.
+static int InternString(List(char) *stringPool, const char *string, int length)
+{
+	int poolSize = ListCount(*stringPool);
+	for (int i = 0; i < poolSize;)
+	{
+		const char *pooled = *stringPool + i;
+		int pooledLength = StringLength(pooled);
+		if (pooledLength == length and BytesEqual(pooled, string, length))
+			return i;
+		i += pooledLength + 1;
+	}
+
+	char *pooled = ListAllocate(stringPool, length + 1);
+	CopyBytes(pooled, string, length);
+	pooled[length] = 0;
+	return poolSize;
 }
 
-static List(int) ConvertToCodepoints(const char *text, int length, List(char) *stringPool)
+// Appends the codepoints of a paragraph to the list. Returns how many were added.
+static int ConvertToCodepoints(const char *text, int length, List(int) *codepoints, List(char) *stringPool)
 {
-	List(int) codepoints = NULL;
+	int start = ListCount(*codepoints);
 
 	int lastNonPauseCodepoint = 0;
 	for (int i = 0; i < length;)
@@ -46,98 +95,91 @@ static List(int) ConvertToCodepoints(const char *text, int length, List(char) *s
 			break;
 		i += advance;
 
-		int lastIndex = ListCount(codepoints) - 1;
-		bool isEscaped = lastIndex > 0 and codepoints[lastIndex] == CONTROL('\\');
+		int lastIndex = ListCount(*codepoints) - 1;
+		bool isEscaped = lastIndex > start and (*codepoints)[lastIndex] == CONTROL('\\');
 
 		if ((codepoint == '[' or codepoint == '{') and not isEscaped)
 		{
 
 			// Expressions go into string memory, and get encoded as CONTROL('[') followed by an index into string memory.
-			int start = i;
+			int stringStart = i;
 			char closing = codepoint == '[' ? ']' : '}';
 			while (i < length and text[i] != closing)
 				++i;
 
-			ListAdd(&codepoints, CONTROL(codepoint));
-			int stringLength = i - start;
+			ListAdd(codepoints, CONTROL(codepoint));
+			int stringLength = i - stringStart;
 			if (stringLength > 0)
-			{
-				int stringIndex = ListCount(*stringPool);
-				char *string = ListAllocate(stringPool, stringLength + 1);
-				CopyBytes(string, text + start, stringLength);
-				string[stringLength] = 0;
-				ListAdd(&codepoints, stringIndex);
-			}
-			else ListAdd(&codepoints, -1); // -1 means "default" expression.
+				ListAdd(codepoints, InternString(stringPool, text + stringStart, stringLength));
+			else ListAdd(codepoints, -1); // -1 means "default" expression.
 
 			++i; // Skip the ]
 		}
 		else if (codepoint == '\\' and not isEscaped)
-			ListAdd(&codepoints, CONTROL('\\'));
+			ListAdd(codepoints, CONTROL('\\'));
 		else if (codepoint == '|' and not isEscaped)
-			ListAdd(&codepoints, CONTROL('|'));
+			ListAdd(codepoints, CONTROL('|'));
 		else if (codepoint == '_' and not isEscaped)
-			ListAdd(&codepoints, CONTROL('_'));
+			ListAdd(codepoints, CONTROL('_'));
 		else if (codepoint == '*' and not isEscaped)
-			ListAdd(&codepoints, CONTROL('*'));
+			ListAdd(codepoints, CONTROL('*'));
 		else if (codepoint == '`' and not isEscaped)
-			ListAdd(&codepoints, CONTROL('`'));
+			ListAdd(codepoints, CONTROL('`'));
 		else if (codepoint == ' ' and isEscaped)
-			codepoints[lastIndex] = ' ';
+			(*codepoints)[lastIndex] = ' ';
 		else if (codepoint == 'n' and isEscaped)
-			codepoints[lastIndex] = '\n';
+			(*codepoints)[lastIndex] = '\n';
 		else if (codepoint == '[' and isEscaped)
-			codepoints[lastIndex] = '[';
+			(*codepoints)[lastIndex] = '[';
 		else if (codepoint == ']' and isEscaped)
-			codepoints[lastIndex] = ']';
+			(*codepoints)[lastIndex] = ']';
 		else if (codepoint == '{' and isEscaped)
-			codepoints[lastIndex] = '{';
+			(*codepoints)[lastIndex] = '{';
 		else if (codepoint == '}' and isEscaped)
-			codepoints[lastIndex] = '}';
+			(*codepoints)[lastIndex] = '}';
 		else if (codepoint == '|' and isEscaped)
-			codepoints[lastIndex] = '|';
+			(*codepoints)[lastIndex] = '|';
 		else if (codepoint == '_' and isEscaped)
-			codepoints[lastIndex] = '_';
+			(*codepoints)[lastIndex] = '_';
 		else if (codepoint == '*' and isEscaped)
-			codepoints[lastIndex] = '*';
+			(*codepoints)[lastIndex] = '*';
 		else if (codepoint == '`' and isEscaped)
-			codepoints[lastIndex] = '`';
+			(*codepoints)[lastIndex] = '`';
 		else if (codepoint == '\\' and isEscaped)
-			codepoints[lastIndex] = '\\';
+			(*codepoints)[lastIndex] = '\\';
 		else if (codepoint == ' ' and not isEscaped and lastNonPauseCodepoint == ' ')
-			ListAdd(&codepoints, CONTROL('`'));
+			ListAdd(codepoints, CONTROL('`'));
 		else if (codepoint == ',' and not isEscaped)
 		{
-			ListAdd(&codepoints, codepoint);
-			ListAdd(&codepoints, CONTROL('`'));
-			ListAdd(&codepoints, CONTROL('`'));
+			ListAdd(codepoints, codepoint);
+			ListAdd(codepoints, CONTROL('`'));
+			ListAdd(codepoints, CONTROL('`'));
 		}
 		else if ((codepoint == '.' or codepoint == '!' or codepoint == '?') and not isEscaped)
 		{
-			ListAdd(&codepoints, codepoint);
-			ListAdd(&codepoints, CONTROL('`'));
-			ListAdd(&codepoints, CONTROL('`'));
-			ListAdd(&codepoints, CONTROL('`'));
-			ListAdd(&codepoints, CONTROL('`'));
+			ListAdd(codepoints, codepoint);
+			ListAdd(codepoints, CONTROL('`'));
+			ListAdd(codepoints, CONTROL('`'));
+			ListAdd(codepoints, CONTROL('`'));
+			ListAdd(codepoints, CONTROL('`'));
 		}
 		else
-			ListAdd(&codepoints, codepoint);
+			ListAdd(codepoints, codepoint);
 
-		int lastCodepoint = codepoints[ListCount(codepoints) - 1];
+		int lastCodepoint = (*codepoints)[ListCount(*codepoints) - 1];
 		if (lastCodepoint != CONTROL('`'))
 			lastNonPauseCodepoint = lastCodepoint;
 	}
 
 	// Remove pauses at the end.
-	while (ListCount(codepoints) > 0 and codepoints[ListCount(codepoints) - 1] == CONTROL('`'))
-		ListPop(&codepoints);
+	while (ListCount(*codepoints) > start and (*codepoints)[ListCount(*codepoints) - 1] == CONTROL('`'))
+		ListPop(codepoints);
 
-	return codepoints;
+	return ListCount(*codepoints) - start;
 }
 
-static float MeasureDuration(List(int) codepoints)
+static float MeasureDuration(const int *codepoints, int numCodepoints)
 {
-	int numCodepoints = ListCount(codepoints);
 	int duration = 0;
 	for (int i = 0; i < numCodepoints; ++i)
 	{
@@ -152,35 +194,187 @@ static float MeasureDuration(List(int) codepoints)
 	return (float)duration;
 }
 
+// Records every time the expression changes in the paragraph, so we can later binary search for the expression at any point in time.
+// Returns how many changes were added.
+static int FindExpressionChanges(const int *codepoints, int numCodepoints, List(ExpressionChange) *changes)
+{
+	int start = ListCount(*changes);
+	float t = 0;
+	for (int i = 0; i < numCodepoints; ++i)
+	{
+		int codepoint = codepoints[i];
+		if (codepoint == CONTROL('['))
+		{
+			ExpressionChange *change = ListAllocateItem(changes);
+			change->time = t;
+			change->stringIndex = codepoints[++i];
+		}
+		else if (codepoint == CONTROL('{'))
+		{
+			++i; // Skip the string index.
+		}
+		else if (not IS_CONTROL(codepoint) or codepoint == CONTROL('`'))
+		{
+			t += 1;
+		}
+	}
+	return ListCount(*changes) - start;
+}
+
+// Commands run when the text reaches them, so they follow the same timing as the glyphs (see LayoutParagraph).
+// Returns how many commands were added.
+static int FindScriptCommands(const int *codepoints, int numCodepoints, List(CommandHeader) *commands)
+{
+	int start = ListCount(*commands);
+	float t = 0;
+	float groupTime = 0;
+	bool group = false;
+	for (int i = 0; i < numCodepoints; ++i)
+	{
+		int codepoint = codepoints[i];
+		if (codepoint == CONTROL('['))
+		{
+			++i; // Skip the string index.
+		}
+		else if (codepoint == CONTROL('{'))
+		{
+			CommandHeader *command = ListAllocateItem(commands);
+			command->stringIndex = codepoints[++i];
+			command->time = group ? groupTime : t;
+		}
+		else if (codepoint == CONTROL('|'))
+		{
+			group = not group;
+			groupTime = t;
+		}
+		else if (not IS_CONTROL(codepoint) or codepoint == CONTROL('`'))
+		{
+			t += 1;
+		}
+	}
+	return ListCount(*commands) - start;
+}
+
 static bool IsWhitespace(int codepoint)
 {
 	return codepoint < 128 && CharIsWhitespace((char)codepoint);
 }
 
-Script LoadScript(const char *path, Font regular, Font bold, Font italic, Font boldItalic)
+static void ClearParagraphLayout(ParagraphLayout *layout)
 {
-	Script script = { 
-		.text = LoadFileText(path), 
-		.font = regular,
-		.boldFont = bold,
-		.italicFont = italic,
-		.boldItalicFont = boldItalic
-	};
+	ListDestroy(&layout->quads);
+	ZeroBytes(layout, sizeof layout[0]);
+}
 
-	if (not script.text)
+// Copies the flat arrays into a single allocation, and points the paragraphs into it.
+static void LoadScriptFromImage(Script *script, const ScriptImage *image)
+{
+	int paragraphsSize = image->numParagraphs * (int)sizeof script->paragraphs[0];
+	int commandsSize = image->numCommands * (int)sizeof script->paragraphs[0].commands[0];
+	int codepointsSize = image->numCodepoints * (int)sizeof image->codepoints[0];
+	int changesSize = image->numExpressionChanges * (int)sizeof image->expressionChanges[0];
+	int arenaSize = paragraphsSize + commandsSize + codepointsSize + changesSize + image->stringPoolSize;
+
+	// Paragraphs and commands go first, they have pointers in them so they need the strictest alignment.
+	// Everything else is 4 byte aligned, or chars.
+	char *arena = MemAlloc(arenaSize > 0 ? arenaSize : 1); // Zeroed, so the paragraph layouts start out empty.
+	script->arena = arena;
+	script->arenaSize = arenaSize;
+	script->numParagraphs = image->numParagraphs;
+	script->paragraphs = (Paragraph *)arena;
+	ScriptCommand *commands = (ScriptCommand *)(arena + paragraphsSize);
+	int *codepoints = (int *)((char *)commands + commandsSize);
+	ExpressionChange *changes = (ExpressionChange *)((char *)codepoints + codepointsSize);
+	script->stringPool = (char *)changes + changesSize;
+	script->stringPoolSize = image->stringPoolSize;
+
+	CopyBytes(codepoints, image->codepoints, codepointsSize);
+	CopyBytes(changes, image->expressionChanges, changesSize);
+	CopyBytes(script->stringPool, image->stringPool, image->stringPoolSize);
+	for (int i = 0; i < image->numCommands; ++i)
 	{
-		LogError("Failed to load script file '%s'.", path);
-		return script;
+		commands[i].stringIndex = image->commands[i].stringIndex;
+		commands[i].time = image->commands[i].time;
+	}
+
+	for (int i = 0; i < image->numParagraphs; ++i)
+	{
+		const ParagraphHeader *header = &image->paragraphs[i];
+		Paragraph *paragraph = &script->paragraphs[i];
+		paragraph->speaker = header->speaker >= 0 ? &script->stringPool[header->speaker] : NULL;
+		paragraph->duration = header->duration;
+		paragraph->initialExpression = header->initialExpression;
+		paragraph->numCodepoints = header->numCodepoints;
+		paragraph->codepoints = codepoints;
+		paragraph->numExpressionChanges = header->numExpressionChanges;
+		paragraph->expressionChanges = changes;
+		paragraph->numCommands = header->numCommands;
+		paragraph->commands = commands;
+		codepoints += header->numCodepoints;
+		changes += header->numExpressionChanges;
+		commands += header->numCommands;
 	}
+}
 
+// Splits every command into its arguments and looks up its handler once, so running a command in the middle of a dialog is just a function call.
+// This is also where we find out about commands that don't exist, or that have the wrong arguments.
+static void BindScriptCommands(Script *script, const char *path)
+{
+	for (int i = 0; i < script->numParagraphs; ++i)
+	{
+		Paragraph *paragraph = &script->paragraphs[i];
+		for (int j = 0; j < paragraph->numCommands; ++j)
+		{
+			ScriptCommand *command = &paragraph->commands[j];
+			const char *text = &script->stringPool[command->stringIndex];
+			int length = StringLength(text);
+			command->argBuffer = MemAlloc(length + 1);
+			CopyBytes(command->argBuffer, text, length + 1);
+
+			// Same rules as the console: arguments are separated by spaces, and ` stands for a space inside of an argument.
+			char *name = NULL;
+			for (char *c = command->argBuffer; *c;)
+			{
+				while (*c == ' ')
+					*c++ = 0;
+				if (not *c)
+					break;
+
+				if (name)
+					ListAdd(&command->args, c);
+				else
+					name = c;
+
+				for (; *c and *c != ' '; ++c)
+					if (*c == '`')
+						*c = ' ';
+			}
+
+			const char *help = NULL;
+			command->handler = name ? BindCommand(name, command->args, &help) : NULL;
+			if (not command->handler)
+			{
+				if (help)
+					LogError("Script '%s' paragraph %d has wrong arguments in command '%s'. Usage: %s.", path, i + 1, text, help);
+				else
+					LogError("Script '%s' paragraph %d has an unknown command '%s'.", path, i + 1, text);
+			}
+		}
+	}
+}
+
+// Parses the text of a script file into lists, which the image points into. Destroy the lists once you're done with the image.
+static void ParseScript(const char *source, ScriptImage *image, List(ParagraphHeader) *paragraphs, List(int) *codepoints,
+	List(ExpressionChange) *changes, List(CommandHeader) *commands, List(char) *stringPool)
+{
 	int fileCursor = 0;
 	for (;;)
 	{
-		Paragraph paragraph = { 0 };
+		ParagraphHeader paragraph = { 0 };
 		
-		while (CharIsWhitespace(script.text[fileCursor]))
+		while (CharIsWhitespace(source[fileCursor]))
 			++fileCursor;
-		char *text = script.text + fileCursor;
+		const char *text = source + fileCursor;
 		if (!text[0])
 			break;
 
@@ -223,7 +417,7 @@ Script LoadScript(const char *path, Font regular, Font bold, Font italic, Font b
 		{
 			int speakerStart = 1;
 			int speakerEnd = -1;
-			char *nextLine = NULL;
+			const char *nextLine = NULL;
 			for (int i = speakerStart; i < textLength; ++i)
 			{
 				if (text[i] == '\n')
@@ -232,7 +426,7 @@ Script LoadScript(const char *path, Font regular, Font bold, Font italic, Font b
 				{
 					// Now we've found the [abc] part, we need to make sure the rest of the line is empty.
 					// If the line isn't empty, then this is an expression, not a speaker name.
-					char *line = text + i + 1;
+					const char *line = text + i + 1;
 					bool onlyWhitespaceAfterSpeaker = true;
 					for (int j = 0; j < textLength; ++j)
 					{
@@ -261,107 +455,322 @@ Script LoadScript(const char *path, Font regular, Font bold, Font italic, Font b
 				foundSpeaker = true;
 				int nameLength = speakerEnd - speakerStart;
 				if (nameLength > 0)
-				{
-					//paragraph.speaker = ListAllocate(&script.stringPool, nameLength + 1);
-					paragraph.speaker = MemAlloc(nameLength + 1);
-					CopyBytes(paragraph.speaker, text + speakerStart, nameLength);
-					paragraph.speaker[nameLength] = 0;
-				}
-				else paragraph.speaker = NULL; // Use the default name.
+					paragraph.speaker = InternString(stringPool, text + speakerStart, nameLength);
+				else
+					paragraph.speaker = -1; // Use the default name.
 
 				int skip = (int)(nextLine - text);
 				text = nextLine;
 				textLength -= skip;
 			}
 		}
+
+		// The expression only carries over between paragraphs if the same character keeps talking.
+		// If we didn't find a name, the character stays the same between paragraphs.
+		int numParagraphs = ListCount(*paragraphs);
+		ParagraphHeader *previous = numParagraphs > 0 ? &(*paragraphs)[numParagraphs - 1] : NULL;
 		if (not foundSpeaker)
-		{
-			// If we didn't find a name, the character stays the same between paragraphs.
-			const char *previousName = NULL;
-			if (script.paragraphs)
-				previousName = script.paragraphs[ListCount(script.paragraphs) - 1].speaker;
+			paragraph.speaker = previous ? previous->speaker : -1;
 
-			if (previousName)
-			{
-				int nameLength = StringLength(previousName);
-				//paragraph.speaker = ListAllocate(&script.stringPool, nameLength + 1);
-				paragraph.speaker = MemAlloc(nameLength + 1);
-				CopyBytes(paragraph.speaker, previousName, nameLength);
-				paragraph.speaker[nameLength] = 0;
-			}
-			else paragraph.speaker = NULL;
+		paragraph.initialExpression = -1;
+		if (previous and previous->speaker == paragraph.speaker) // Strings are interned, so equal names have equal indices.
+		{
+			if (previous->numExpressionChanges > 0)
+				paragraph.initialExpression = (*changes)[ListCount(*changes) - 1].stringIndex;
+			else
+				paragraph.initialExpression = previous->initialExpression;
 		}
 
 		fileCursor += cursor;
-		paragraph.text = text;
-		paragraph.textLength = textLength;
-		paragraph.codepoints = ConvertToCodepoints(text, textLength, &script.stringPool);
-		paragraph.duration = MeasureDuration(paragraph.codepoints);
-		ListAdd(&script.paragraphs, paragraph);
+		int firstCodepoint = ListCount(*codepoints);
+		paragraph.numCodepoints = ConvertToCodepoints(text, textLength, codepoints, stringPool);
+		const int *paragraphCodepoints = *codepoints + firstCodepoint;
+		paragraph.duration = MeasureDuration(paragraphCodepoints, paragraph.numCodepoints);
+		paragraph.numExpressionChanges = FindExpressionChanges(paragraphCodepoints, paragraph.numCodepoints, changes);
+		paragraph.numCommands = FindScriptCommands(paragraphCodepoints, paragraph.numCodepoints, commands);
+
+		ListAdd(paragraphs, paragraph);
 	}
 
-	LogInfo("Script '%s' loaded successfully (%d paragraphs).", path, ListCount(script.paragraphs));
+	image->numParagraphs = ListCount(*paragraphs);
+	image->paragraphs = *paragraphs;
+	image->numCodepoints = ListCount(*codepoints);
+	image->codepoints = *codepoints;
+	image->numExpressionChanges = ListCount(*changes);
+	image->expressionChanges = *changes;
+	image->numCommands = ListCount(*commands);
+	image->commands = *commands;
+	image->stringPoolSize = ListCount(*stringPool);
+	image->stringPool = *stringPool;
+}
+
+// Each script has one cache file, named after the hash of its path, so editing a script overwrites its old cache instead of piling up new ones.
+// The header has the hash of the script text, so an edited script never picks up a stale cache.
+static const char *GetScriptCachePath(const char *scriptPath)
+{
+	return TempFormat("%s/%08x.scriptc", SCRIPT_CACHE_DIRECTORY, HashString(scriptPath));
+}
+
+// Points the image into the cache file data. Returns false if there's no usable cache for this source text.
+static bool ReadScriptCache(BinaryStream *stream, unsigned sourceHash, int sourceLength, ScriptImage *image)
+{
+	const void *magic = ReadBytes(stream, 4);
+	if (not magic or not BytesEqual(magic, SCRIPT_CACHE_MAGIC, 4))
+		return false;
+	if (ReadInt(stream) != SCRIPT_CACHE_VERSION)
+		return false;
+	if ((unsigned)ReadInt(stream) != sourceHash or ReadInt(stream) != sourceLength)
+		return false; // The script was edited since (or another script has the same path hash).
+
+	image->numParagraphs = ReadInt(stream);
+	image->numCodepoints = ReadInt(stream);
+	image->numExpressionChanges = ReadInt(stream);
+	image->numCommands = ReadInt(stream);
+	image->stringPoolSize = ReadInt(stream);
+	if (image->numParagraphs < 0 or image->numCodepoints < 0 or image->numExpressionChanges < 0 or image->numCommands < 0 or image->stringPoolSize < 0)
+		return false;
+
+	image->paragraphs = ReadBytes(stream, image->numParagraphs * (int)sizeof image->paragraphs[0]);
+	image->codepoints = ReadBytes(stream, image->numCodepoints * (int)sizeof image->codepoints[0]);
+	image->expressionChanges = ReadBytes(stream, image->numExpressionChanges * (int)sizeof image->expressionChanges[0]);
+	image->commands = ReadBytes(stream, image->numCommands * (int)sizeof image->commands[0]);
+	image->stringPool = ReadBytes(stream, image->stringPoolSize);
+	if ((image->numParagraphs and not image->paragraphs) or (image->numCodepoints and not image->codepoints) or
+		(image->numExpressionChanges and not image->expressionChanges) or (image->numCommands and not image->commands) or
+		(image->stringPoolSize and not image->stringPool))
+		return false; // Cut short.
+
+	// The file could still be damaged, so make sure nothing points outside of the arrays.
+	int poolSize = image->stringPoolSize;
+	if (poolSize > 0 and image->stringPool[poolSize - 1] != 0)
+		return false;
+
+	int numCodepoints = 0;
+	int numChanges = 0;
+	int numCommands = 0;
+	for (int i = 0; i < image->numParagraphs; ++i)
+	{
+		const ParagraphHeader *header = &image->paragraphs[i];
+		if (header->numCodepoints < 0 or header->numExpressionChanges < 0 or header->numCommands < 0)
+			return false;
+		if (header->speaker < -1 or header->speaker >= poolSize or header->initialExpression < -1 or header->initialExpression >= poolSize)
+			return false;
+		numCodepoints += header->numCodepoints;
+		numChanges += header->numExpressionChanges;
+		numCommands += header->numCommands;
+	}
+	if (numCodepoints != image->numCodepoints or numChanges != image->numExpressionChanges or numCommands != image->numCommands)
+		return false;
+
+	for (int i = 0; i < image->numCodepoints; ++i)
+	{
+		int codepoint = image->codepoints[i];
+		if (codepoint == CONTROL('[') or codepoint == CONTROL('{'))
+		{
+			if (i + 1 >= image->numCodepoints or image->codepoints[i + 1] < -1 or image->codepoints[i + 1] >= poolSize)
+				return false;
+			++i;
+		}
+	}
+	for (int i = 0; i < image->numExpressionChanges; ++i)
+		if (image->expressionChanges[i].stringIndex < -1 or image->expressionChanges[i].stringIndex >= poolSize)
+			return false;
+	for (int i = 0; i < image->numCommands; ++i)
+		if (image->commands[i].stringIndex < 0 or image->commands[i].stringIndex >= poolSize)
+			return false;
+
+	return true;
+}
+
+static void WriteScriptCache(const char *scriptPath, unsigned sourceHash, int sourceLength, const ScriptImage *image)
+{
+	BinaryStream stream = CreateGrowableBinaryStream(1024);
+	WriteBytes(&stream, SCRIPT_CACHE_MAGIC, 4);
+	WriteInt(&stream, SCRIPT_CACHE_VERSION);
+	WriteInt(&stream, (int)sourceHash);
+	WriteInt(&stream, sourceLength);
+	WriteInt(&stream, image->numParagraphs);
+	WriteInt(&stream, image->numCodepoints);
+	WriteInt(&stream, image->numExpressionChanges);
+	WriteInt(&stream, image->numCommands);
+	WriteInt(&stream, image->stringPoolSize);
+	WriteBytes(&stream, image->paragraphs, image->numParagraphs * (int)sizeof image->paragraphs[0]);
+	WriteBytes(&stream, image->codepoints, image->numCodepoints * (int)sizeof image->codepoints[0]);
+	WriteBytes(&stream, image->expressionChanges, image->numExpressionChanges * (int)sizeof image->expressionChanges[0]);
+	WriteBytes(&stream, image->commands, image->numCommands * (int)sizeof image->commands[0]);
+	WriteBytes(&stream, image->stringPool, image->stringPoolSize);
+
+	// The cache is just an optimization, so it's fine if we can't write it (for example if the game directory is read-only).
+	if (stream.buffer and EnsureDirectoryExists(SCRIPT_CACHE_DIRECTORY))
+		SaveFileDataAtomically(GetScriptCachePath(scriptPath), stream.buffer, stream.cursor);
+	DestroyGrowableBinaryStream(&stream);
+}
+
+Script LoadScript(const char *path, GameFont *regular, GameFont *bold, GameFont *italic, GameFont *boldItalic)
+{
+	Script script = { 
+		.font = regular,
+		.boldFont = bold,
+		.italicFont = italic,
+		.boldItalicFont = boldItalic
+	};
+
+	char *source = LoadAssetText(path);
+	if (not source)
+	{
+		LogError("Failed to load script file '%s'.", path);
+		return script;
+	}
+
+	unsigned sourceHash = HashString(source);
+	int sourceLength = StringLength(source);
+
+	// Try the cache first, it's already in the exact shape we need.
+	// Check first, so raylib doesn't warn about a missing file every time a script is loaded cold.
+	const char *cachePath = GetScriptCachePath(path);
+	unsigned cacheSize = 0;
+	unsigned char *cache = FileExists(cachePath) ? LoadFileData(cachePath, &cacheSize) : NULL;
+	if (cache)
+	{
+		BinaryStream stream = { 0 };
+		stream.buffer = cache;
+		stream.size = (int)cacheSize;
+
+		ScriptImage image = { 0 };
+		if (ReadScriptCache(&stream, sourceHash, sourceLength, &image))
+			LoadScriptFromImage(&script, &image);
+		UnloadFileData(cache);
+	}
+
+	if (not script.arena)
+	{
+		List(ParagraphHeader) paragraphs = NULL;
+		List(int) codepoints = NULL;
+		List(ExpressionChange) changes = NULL;
+		List(CommandHeader) commands = NULL;
+		List(char) stringPool = NULL;
+
+		ScriptImage image = { 0 };
+		ParseScript(source, &image, &paragraphs, &codepoints, &changes, &commands, &stringPool);
+		LoadScriptFromImage(&script, &image);
+		WriteScriptCache(path, sourceHash, sourceLength, &image);
+
+		ListDestroy(&paragraphs);
+		ListDestroy(&codepoints);
+		ListDestroy(&changes);
+		ListDestroy(&commands);
+		ListDestroy(&stringPool);
+	}
+	UnloadFileText(source);
+	BindScriptCommands(&script, path);
+
+	LogInfo("Script '%s' loaded successfully (%d paragraphs).", path, script.numParagraphs);
 	return script;
 }
 
 void UnloadScript(Script *script)
 {
-	if (not script or not script->text)
+	if (not script or not script->arena)
 		return;
 
-	for (int i = 0; i < ListCount(script->paragraphs); ++i)
+	for (int i = 0; i < script->numParagraphs; ++i)
 	{
 		Paragraph *paragraph = &script->paragraphs[i];
-		ListDestroy(&paragraph->codepoints);
-		MemFree(paragraph->speaker);
+		ClearParagraphLayout(&paragraph->layout);
+		for (int j = 0; j < paragraph->numCommands; ++j)
+		{
+			ListDestroy(&paragraph->commands[j].args);
+			MemFree(paragraph->commands[j].argBuffer);
+		}
 	}
-	ListDestroy(&script->paragraphs);
-	ListDestroy(&script->stringPool);
-	UnloadFileText(script->text);
-	script->text = NULL;
+	MemFree(script->arena);
+	script->arena = NULL;
+	script->arenaSize = 0;
+	script->paragraphs = NULL;
+	script->numParagraphs = 0;
+	script->stringPool = NULL;
+	script->stringPoolSize = 0;
 	script->commandIndex = 0;
 	LogInfo("Script unloaded.");
 }
 
-void DrawScriptParagraph(Script *script, int paragraphIndex, Rectangle textBox, float fontSize, Color color, Color shadowColor, float time)
+// Returns how wide the word starting at the given codepoint will be. The word ends at whitespace or an expression.
+static float MeasureWord(const int *codepoints, int numCodepoints, int start, GameFont *fonts[STYLE_ENUM_COUNT], Style style, float fontSize)
+{
+	float width = 0;
+	for (int i = start; i < numCodepoints and not IsWhitespace(codepoints[i]) and codepoints[i] != CONTROL('['); ++i)
+	{
+		int codepoint = codepoints[i];
+		if (codepoint == CONTROL('{'))
+			++i; // Skip the string index.
+		else if (codepoint == CONTROL('*'))
+			style ^= BOLD;
+		else if (codepoint == CONTROL('_'))
+			style ^= ITALIC;
+		else if (not IS_CONTROL(codepoint))
+		{
+			int index = GetGameFontGlyphIndex(fonts[style], codepoint);
+			width += GetGameFontAdvance(fonts[style], index, fontSize);
+		}
+	}
+	return width;
+}
+
+// Returns how many of the quads are visible at the given time.
+static int CountVisibleQuads(List(GlyphQuad) quads, float time)
 {
-	paragraphIndex = ClampInt(paragraphIndex, 0, ListCount(script->paragraphs) - 1);
-	Paragraph paragraph = script->paragraphs[paragraphIndex];
-	List(int) codepoints = paragraph.codepoints;
-	int numCodepoints = ListCount(codepoints);
+	int low = 0;
+	int high = ListCount(quads);
+	while (low < high)
+	{
+		int middle = low + (high - low) / 2;
+		if (quads[middle].time < time)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+// Figures out where every glyph in the paragraph goes, and at what time it appears.
+// We do this once and bake the glyphs into quads, so drawing just sends the visible ones straight to the GPU.
+static void LayoutParagraph(Script *script, Paragraph *paragraph, float width, float fontSize)
+{
+	ParagraphLayout *layout = &paragraph->layout;
+	ClearParagraphLayout(layout);
+	layout->width = width;
+	layout->fontSize = fontSize;
+
+	const int *codepoints = paragraph->codepoints;
+	int numCodepoints = paragraph->numCodepoints;
 
-	Font fonts[STYLE_ENUM_COUNT] = {
+	GameFont *fonts[STYLE_ENUM_COUNT] = {
 		[REGULAR    ] = script->font,
 		[BOLD       ] = script->boldFont,
 		[ITALIC     ] = script->italicFont,
 		[BOLD_ITALIC] = script->boldItalicFont
 	};
 
-	float x = textBox.x;
-	float y = textBox.y;
+	float x = 0;
+	float y = 0;
 	float t = 0;
+	float groupTime = 0; // Everything in a group appears at the time the group started.
 	Style style = REGULAR;
 	bool group = false;
-	float maxX = textBox.x + textBox.width;
-	int commandIndex = 0;
+	bool inWord = false;
 
-	for (int i = 0; i < numCodepoints and (group or t < time); ++i)
+	for (int i = 0; i < numCodepoints; ++i)
 	{
 		int codepoint = codepoints[i];
+		float revealTime = group ? groupTime : t;
 		if (codepoint == CONTROL('['))
 		{
 			++i; // Skip the string index.
+			inWord = false;
 		}
 		else if (codepoint == CONTROL('{'))
 		{
-			int stringIndex = codepoints[++i];
-			char *command = &script->stringPool[stringIndex];
-			if (++commandIndex > script->commandIndex)
-			{
-				script->commandIndex++;
-				LogInfo("Script executing command %d: '%s'.", script->commandIndex, command);
-				ExecuteCommand(command);
-			}
+			++i; // Skip the string index, commands are handled by FindScriptCommands.
 		}
 		else if (codepoint == CONTROL('*'))
 		{
@@ -374,116 +783,129 @@ void DrawScriptParagraph(Script *script, int paragraphIndex, Rectangle textBox,
 		else if (codepoint == CONTROL('|'))
 		{
 			group = not group;
+			groupTime = t;
 		}
 		else if (IsWhitespace(codepoint) or codepoint == CONTROL('`'))
 		{
 			t += 1;
 			if (codepoint == '\n')
 			{
-				x = textBox.x;
+				x = 0;
 				y += GetLineHeight(fonts[style], fontSize);
+				inWord = false;
 			}
 			else if (codepoint != CONTROL('`'))
 			{
-				Font font = fonts[style];
-				int index = GetGlyphIndex(font, codepoint);
-				x += GetAdvance(font, fontSize, index);
-				if (x > maxX)
+				int index = GetGameFontGlyphIndex(fonts[style], codepoint);
+				x += GetGameFontAdvance(fonts[style], index, fontSize);
+				if (x > width)
 				{
-					x = textBox.x;
+					x = 0;
 					y += GetLineHeight(fonts[style], fontSize);
 				}
+				inWord = false;
 			}
 		}
 		else
 		{
-			//@TODO @SPEED This is EXTREMELY inneficient
-			// We draw every word character by character, but we scan through it to see if it will fit on the line every single time
-			// so it's O(n^2) performance when it could easily be O(1). Could be fixed, but it would require basically copy pasting the
-			// above control code checks into the loop of the word drawing itself, and I don't wanna do that right now soo...
-
-			// Check if the word will fit on the line, and if it doesn't, break the line before drawing the word.
-			float width = 0;
-			Style backupStyle = style;
-			for (int j = i; j < numCodepoints and not IsWhitespace(codepoints[j]) and codepoints[j] != CONTROL('['); ++j)
+			// Check if the word will fit on the line, and if it doesn't, break the line before the word.
+			if (not inWord)
 			{
-				codepoint = codepoints[j];
-				if (codepoint == CONTROL('*'))
-					style ^= BOLD;
-				else if (codepoint == CONTROL('_'))
-					style ^= ITALIC;
-				else if (not IS_CONTROL(codepoint))
+				inWord = true;
+				if (x > 0 and x + MeasureWord(codepoints, numCodepoints, i, fonts, style, fontSize) > width)
 				{
-					Font font = fonts[style];
-					int index = GetGlyphIndex(font, codepoint);
-					width += GetAdvance(font, fontSize, index);
+					x = 0;
+					y += GetLineHeight(fonts[style], fontSize);
 				}
 			}
 
-			// Word is too long to fit onto current line. Break the line.
-			if (x + width > maxX)
+			int index = GetGameFontGlyphIndex(fonts[style], codepoint);
+			float advance = GetGameFontAdvance(fonts[style], index, fontSize);
+
+			// Words that are longer than a whole line get broken wherever they run out of space.
+			if (x > 0 and x + advance > width)
 			{
-				x = textBox.x;
+				x = 0;
 				y += GetLineHeight(fonts[style], fontSize);
 			}
 
-			style = backupStyle;
-			codepoint = codepoints[i];
-
-			// @SPEED Here we could draw the entire word instead of just the one character.
-			{
-				Font font = fonts[style];
-				int index = GetGlyphIndex(font, codepoint);
-				DrawTextCodepoint(font, codepoint, (Vector2) { x + 2, y + 2 }, fontSize, shadowColor);
-				DrawTextCodepoint(font, codepoint, (Vector2) { x, y }, fontSize, color);
-				x += GetAdvance(font, fontSize, index);
-				t += 1;
-			}
+			GlyphQuad *quad = ListAllocateItem(&layout->quads);
+			*quad = GetGlyphQuad(fonts[style], index, x, y, fontSize);
+			quad->time = revealTime;
+			x += advance;
+			t += 1;
 		}
 	}
+
+	// Only once we're done, since laying out might have evicted other glyphs from the cache.
+	layout->glyphCacheGeneration = GetGlyphCacheGeneration();
 }
 
-const char *GetScriptExpression(Script script, int paragraphIndex, float time)
+void ExecuteScriptCommands(Script *script, int paragraphIndex, float time)
 {
-	// @SPEED The very existance of this call is inneficient.
-	// It basically has to crawl through the entire script to find the expression.
-	const char *prevSpeaker = "";
-	const char *expression = "default";
-	paragraphIndex = ClampInt(paragraphIndex, 0, ListCount(script.paragraphs) - 1); 
-
-	for (int i = 0; i <= paragraphIndex; ++i)
+	paragraphIndex = ClampInt(paragraphIndex, 0, script->numParagraphs - 1);
+	const Paragraph *paragraph = &script->paragraphs[paragraphIndex];
+	const ScriptCommand *commands = paragraph->commands;
+	for (int i = 0; i < paragraph->numCommands and commands[i].time < time; ++i)
 	{
-		Paragraph paragraph = script.paragraphs[i];
-		if (not StringsEqual(paragraph.speaker, prevSpeaker))
+		if (i + 1 > script->commandIndex)
 		{
-			prevSpeaker = paragraph.speaker;
-			expression = "default";
+			const ScriptCommand *command = &commands[i];
+			const char *text = &script->stringPool[command->stringIndex];
+			script->commandIndex++;
+			LogInfo("Script executing command %d: '%s'.", script->commandIndex, text);
+
+			// Commands that didn't bind were already reported when the script loaded.
+			if (command->handler and not command->handler(command->args))
+				LogError("Script command '%s' failed.", text);
 		}
+	}
+}
 
-		List(int) codepoints = paragraph.codepoints;
-		int numCodepoints = ListCount(codepoints);
-		float t = 0;
-		for (int j = 0; j < numCodepoints and (t < time or i != paragraphIndex); ++j)
-		{
-			int codepoint = codepoints[j];
-			if (codepoint == CONTROL('['))
-			{
-				int stringIndex = codepoints[++j];
-				if (stringIndex == -1)
-					expression = "default";
-				else
-					expression = &script.stringPool[stringIndex];
-			}
-			else if (codepoint == CONTROL('{'))
-			{
-				++j; // Skip the string index.
-			}
-			else if (not IS_CONTROL(codepoint) or codepoint == CONTROL('`'))
-			{
-				t += 1;
-			}
-		}
+void DrawScriptParagraph(Script *script, int paragraphIndex, Rectangle textBox, float fontSize, Color color, Color shadowColor, float time)
+{
+	paragraphIndex = ClampInt(paragraphIndex, 0, script->numParagraphs - 1);
+	Paragraph *paragraph = &script->paragraphs[paragraphIndex];
+	ParagraphLayout *layout = &paragraph->layout;
+	if (layout->width != textBox.width or layout->fontSize != fontSize or layout->glyphCacheGeneration != GetGlyphCacheGeneration())
+	{
+		PROFILE_BEGIN("LayoutParagraph");
+		LayoutParagraph(script, paragraph, textBox.width, fontSize);
+		PROFILE_END();
+	}
+
+	PROFILE_BEGIN("DrawScriptParagraph");
+	{
+		// All the shadows go first, so a shadow never ends up on top of another glyph.
+		int numVisible = CountVisibleQuads(layout->quads, time);
+		DrawGlyphQuads(layout->quads, numVisible, (Vector2){ textBox.x + 2, textBox.y + 2 }, shadowColor);
+		DrawGlyphQuads(layout->quads, numVisible, (Vector2){ textBox.x, textBox.y }, color);
+	}
+	PROFILE_END();
+}
+
+const char *GetScriptExpression(Script script, int paragraphIndex, float time)
+{
+	paragraphIndex = ClampInt(paragraphIndex, 0, script.numParagraphs - 1);
+	Paragraph *paragraph = &script.paragraphs[paragraphIndex];
+	const ExpressionChange *changes = paragraph->expressionChanges;
+
+	// Binary search for the last change that happened before the given time.
+	int stringIndex = paragraph->initialExpression;
+	int low = 0;
+	int high = paragraph->numExpressionChanges;
+	while (low < high)
+	{
+		int middle = low + (high - low) / 2;
+		if (changes[middle].time < time)
+			low = middle + 1;
+		else
+			high = middle;
 	}
+	if (low > 0)
+		stringIndex = changes[low - 1].stringIndex;
 
-	return expression;
+	if (stringIndex == -1)
+		return "default";
+	return &script.stringPool[stringIndex];
 }
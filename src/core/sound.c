@@ -1,6 +1,14 @@
 #include "../core.h"
 
-static List(Sound *) temporarySounds;
+STRUCT(TemporarySound)
+{
+	Sound *sound;
+	float volume;
+	float pitch;
+	bool isStarted; // Sounds load in the background, so we might have to wait a few frames before we can play them.
+};
+
+static List(TemporarySound) temporarySounds;
 
 void PlayTemporarySound(const char *path)
 {
@@ -12,25 +20,38 @@ void PlayTemporarySoundEx(const char *path, float volume, float pitch)
 	Sound *sound = AcquireSound(path);
 	if (not sound)
 	{
-		if (not FileExists(path))
+		if (not AssetExists(path))
 			LogError("Couldn't play temporary sound '%s' because the file doesn't exist.", path);
 		else
 			LogError("Couldn't play temporary sound '%s'.", path);
 		return;
 	}
 
-	SetSoundVolume(*sound, volume);
-	SetSoundPitch(*sound, pitch);
-	PlaySound(*sound);
-	ListAdd(&temporarySounds, sound);
+	TemporarySound *temporary = ListAllocateItem(&temporarySounds);
+	temporary->sound = sound;
+	temporary->volume = volume;
+	temporary->pitch = pitch;
+	temporary->isStarted = false;
+	UpdateTemporarySounds(); // Start it right away if it's already loaded.
 }
 
 void UpdateTemporarySounds(void)
 {
 	for (int i = 0; i < ListCount(temporarySounds); ++i)
 	{
-		Sound *sound = temporarySounds[i];
-		if (not IsSoundPlaying(*sound))
+		TemporarySound *temporary = &temporarySounds[i];
+		Sound *sound = temporary->sound;
+		if (not temporary->isStarted)
+		{
+			if (IsAssetReady(sound))
+			{
+				SetSoundVolume(*sound, temporary->volume);
+				SetSoundPitch(*sound, temporary->pitch);
+				PlaySound(*sound);
+				temporary->isStarted = true;
+			}
+		}
+		else if (not IsSoundPlaying(*sound))
 		{
 			ReleaseAsset(sound);
 			ListSwapRemove(&temporarySounds, i);
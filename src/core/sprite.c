@@ -2,51 +2,81 @@
 
 Sprite LoadSprite(const char *path)
 {
-	Sprite s = { 0 };
-	if (not FileExists(path))
+	SpriteImages images = LoadSpriteImages(path);
+	Sprite s = LoadSpriteFromImages(images);
+	UnloadSpriteImages(images);
+	return s;
+}
+
+void UnloadSprite(Sprite sprite)
+{
+	for (int i = 0; i < sprite.numFrames; ++i)
+		RemoveFromAtlas(sprite.frames[i]);
+	MemFree(sprite.frames);
+}
+
+SpriteImages LoadSpriteImages(const char *path)
+{
+	SpriteImages s = { 0 };
+	if (not AssetExists(path))
 	{
 		LogError("Couldn't load sprite from '%s' because that path doesn't exist.", path);
 		return s;
 	}
 
-	if (IsPathFile(path))
+	int numPackedFrames = GetPackedDirectoryFileCount(path);
+	if (numPackedFrames == 0)
+		LogError("Couldn't load sprite from '%s' because the directory is empty.", path);
+	else if (numPackedFrames > 0)
+	{
+		s.numFrames = numPackedFrames;
+		s.frames = MemAlloc(s.numFrames * sizeof s.frames[0]);
+		for (int i = 0; i < s.numFrames; ++i)
+			s.frames[i] = LoadAssetImage(GetPackedDirectoryFilePath(path, i));
+	}
+	else if (IsInAssetPack(path) or IsPathFile(path))
 	{
 		s.numFrames = 1;
 		s.frames = MemAlloc(sizeof s.frames[0]);
-		s.frames[0] = LoadTexture(path);
+		s.frames[0] = LoadAssetImage(path);
 	}
 	else
 	{
 		FilePathList contents = LoadDirectoryFiles(path);
 		{
 			if (not contents.count)
-			{
 				LogError("Couldn't load sprite from '%s' because the directory is empty.", path);
-				return s;
-			}
 			else
 			{
 				s.numFrames = (int)contents.count;
 				s.frames = MemAlloc(s.numFrames * sizeof s.frames[0]);
 				for (int i = 0; i < s.numFrames; ++i)
-					s.frames[i] = LoadTexture(contents.paths[i]);
+					s.frames[i] = LoadImage(contents.paths[i]);
 			}
 		}
 		UnloadDirectoryFiles(contents);
 	}
 
-	for (int i = 0; i < s.numFrames; ++i)
-	{
-		SetTextureWrap(s.frames[i], TEXTURE_WRAP_CLAMP);
-		SetTextureFilter(s.frames[i], TEXTURE_FILTER_BILINEAR);
-	}
-
 	return s;
 }
 
-void UnloadSprite(Sprite sprite)
+void UnloadSpriteImages(SpriteImages images)
 {
-	for (int i = 0; i < sprite.numFrames; ++i)
-		UnloadTexture(sprite.frames[i]);
-	MemFree(sprite.frames);
+	for (int i = 0; i < images.numFrames; ++i)
+		UnloadImage(images.frames[i]);
+	MemFree(images.frames);
+}
+
+Sprite LoadSpriteFromImages(SpriteImages images)
+{
+	Sprite s = { 0 };
+	if (not images.numFrames)
+		return s;
+
+	s.numFrames = images.numFrames;
+	s.frames = MemAlloc(s.numFrames * sizeof s.frames[0]);
+	for (int i = 0; i < s.numFrames; ++i)
+		s.frames[i] = AddToAtlas(images.frames[i]);
+
+	return s;
 }
@@ -13,6 +13,8 @@ static SlabAllocator allocator = {
 	.slab = &firstSlab
 };
 
+static int highWaterMark;
+
 void *TempAlloc(int numBytes)
 {
 	return AllocateFromSlabAllocator(&allocator, numBytes);
@@ -35,9 +37,19 @@ int TempMark(void)
 
 void TempReset(int mark)
 {
+	// The cursor only goes up between resets, so this is where it peaks.
+	if (highWaterMark < allocator.cursor)
+		highWaterMark = allocator.cursor;
 	ResetSlabAllocator(&allocator, mark);
 }
 
+int GetTempHighWaterMark(void)
+{
+	if (highWaterMark < allocator.cursor)
+		highWaterMark = allocator.cursor;
+	return highWaterMark;
+}
+
 void *TempCopy(const void *bytes, int numBytes)
 {
 	void *copy = TempAlloc(numBytes);
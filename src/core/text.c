@@ -1,19 +1,445 @@
 #include "../core.h"
 
-Font LoadFontAscii(const char *path, int fontSize)
+// We only use some of stb_truetype, so don't warn about the functions we don't use.
+#ifdef __GNUC__
+#	pragma GCC diagnostic push
+#	pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#define STB_TRUETYPE_IMPLEMENTATION
+#define STBTT_STATIC
+#include "../lib/imgui/imstb_truetype.h"
+#ifdef __GNUC__
+#	pragma GCC diagnostic pop
+#endif
+
+// Glyphs aren't rasterized up front. The first time a glyph is drawn it gets rasterized into the glyph cache,
+// a few atlas pages that all fonts share. That way any Unicode text works, and no matter how many fonts or
+// languages we load, the cache never takes more than MAX_GLYPH_PAGES pages.
+//
+// The pages are split into equal cells, so any glyph can take the place of any other one. Once all cells are taken,
+// the glyph that was drawn the longest time ago gets evicted. Glyph quads that were baked earlier might still point
+// to the evicted cell, so every eviction bumps the cache generation, and layouts from an older generation are redone.
+// Glyphs are rasterized at the font's base size, which has to fit in a cell (fonts are loaded at 32 px right now).
+
+#define GLYPH_PAGE_SIZE 1024
+#define GLYPH_CELL_SIZE 64
+#define GLYPH_PADDING 1
+#define GLYPH_CELLS_PER_ROW (GLYPH_PAGE_SIZE / GLYPH_CELL_SIZE)
+#define GLYPH_CELLS_PER_PAGE (GLYPH_CELLS_PER_ROW * GLYPH_CELLS_PER_ROW)
+#define MAX_GLYPH_PAGES 4 // 2 MB each.
+
+STRUCT(GlyphCell)
+{
+	GameFont *font; // NULL if the cell is free.
+	int glyphIndex; // Into font->glyphs.
+	int older; // Cells are kept in a list from the least to the most recently used, -1 marks the ends.
+	int newer;
+};
+
+static Texture glyphPages[MAX_GLYPH_PAGES];
+static int numGlyphPages;
+static GlyphCell glyphCells[MAX_GLYPH_PAGES * GLYPH_CELLS_PER_PAGE];
+static int numGlyphCells; // Cells past this were never used.
+static int numCachedGlyphs;
+static int oldestGlyphCell = -1;
+static int newestGlyphCell = -1;
+static unsigned glyphCacheGeneration;
+
+static void UnlinkGlyphCell(int cell)
+{
+	GlyphCell *c = &glyphCells[cell];
+	if (c->older >= 0)
+		glyphCells[c->older].newer = c->newer;
+	else
+		oldestGlyphCell = c->newer;
+	if (c->newer >= 0)
+		glyphCells[c->newer].older = c->older;
+	else
+		newestGlyphCell = c->older;
+	c->older = -1;
+	c->newer = -1;
+}
+
+static void LinkNewestGlyphCell(int cell)
+{
+	GlyphCell *c = &glyphCells[cell];
+	c->older = newestGlyphCell;
+	c->newer = -1;
+	if (newestGlyphCell >= 0)
+		glyphCells[newestGlyphCell].newer = cell;
+	else
+		oldestGlyphCell = cell;
+	newestGlyphCell = cell;
+}
+
+static void LinkOldestGlyphCell(int cell)
+{
+	GlyphCell *c = &glyphCells[cell];
+	c->older = -1;
+	c->newer = oldestGlyphCell;
+	if (oldestGlyphCell >= 0)
+		glyphCells[oldestGlyphCell].older = cell;
+	else
+		newestGlyphCell = cell;
+	oldestGlyphCell = cell;
+}
+
+static void TouchGlyphCell(int cell)
 {
-	int ascii[128];
-	for (int i = 0; i < COUNTOF(ascii); ++i)
-		ascii[i] = i;
-	return LoadFontEx(path, fontSize, ascii, COUNTOF(ascii));
+	if (cell != newestGlyphCell)
+	{
+		UnlinkGlyphCell(cell);
+		LinkNewestGlyphCell(cell);
+	}
 }
 
-float GetLineHeight(Font font, float fontSize)
+static int AllocateGlyphCell(void)
 {
-	return font.baseSize * (fontSize / font.baseSize);
+	if (numGlyphCells == numGlyphPages * GLYPH_CELLS_PER_PAGE and numGlyphPages < MAX_GLYPH_PAGES)
+	{
+		// Every pixel that gets sampled is written when its glyph is added, so it doesn't matter what's in the texture initially.
+		Texture *page = &glyphPages[numGlyphPages++];
+		page->id = rlLoadTexture(NULL, GLYPH_PAGE_SIZE, GLYPH_PAGE_SIZE, PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA, 1);
+		page->width = GLYPH_PAGE_SIZE;
+		page->height = GLYPH_PAGE_SIZE;
+		page->mipmaps = 1;
+		page->format = PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA;
+	}
+
+	int cell;
+	if (numGlyphCells < numGlyphPages * GLYPH_CELLS_PER_PAGE)
+		cell = numGlyphCells++;
+	else
+	{
+		cell = oldestGlyphCell;
+		UnlinkGlyphCell(cell);
+		if (glyphCells[cell].font)
+		{
+			glyphCells[cell].font = NULL;
+			--numCachedGlyphs;
+			++glyphCacheGeneration;
+		}
+	}
+
+	LinkNewestGlyphCell(cell);
+	return cell;
 }
 
-void DrawFormat(Font font, float x, float y, float fontSize, Color color, FORMAT_STRING format, ...)
+// Returns the cell the glyph is in, rasterizing it first if it isn't in the cache. Returns -1 if the glyph has no pixels.
+static int CacheGlyph(GameFont *font, int glyphIndex)
+{
+	FontGlyph *glyph = &font->glyphs[glyphIndex];
+	if (glyph->box.width <= 0 or glyph->box.height <= 0)
+		return -1;
+
+	#ifdef HEADLESS
+	{
+		// No GPU, there's nowhere to put the pixels.
+		return -1;
+	}
+	#endif
+
+	int cell = glyph->cell;
+	if (cell >= 0 and glyphCells[cell].font == font and glyphCells[cell].glyphIndex == glyphIndex)
+	{
+		TouchGlyphCell(cell);
+		return cell;
+	}
+
+	cell = AllocateGlyphCell();
+	glyphCells[cell].font = font;
+	glyphCells[cell].glyphIndex = glyphIndex;
+	glyph->cell = cell;
+	++numCachedGlyphs;
+
+	// Gray is always white and the glyph goes in the alpha channel, same as in raylib's font atlases.
+	int width = (int)glyph->box.width;
+	int height = (int)glyph->box.height;
+	int paddedWidth = width + 2 * GLYPH_PADDING;
+	int paddedHeight = height + 2 * GLYPH_PADDING;
+	unsigned char *coverage = MemAlloc(width * height);
+	stbtt_MakeGlyphBitmap(font->truetype, coverage, width, height, width, font->truetypeScale, font->truetypeScale, glyph->truetypeGlyph);
+	unsigned char *pixels = MemAlloc(2 * paddedWidth * paddedHeight);
+	for (int y = 0; y < paddedHeight; ++y)
+	{
+		for (int x = 0; x < paddedWidth; ++x)
+		{
+			int sourceX = x - GLYPH_PADDING;
+			int sourceY = y - GLYPH_PADDING;
+			bool isPadding = sourceX < 0 or sourceX >= width or sourceY < 0 or sourceY >= height;
+			pixels[2 * (y * paddedWidth + x) + 0] = 255;
+			pixels[2 * (y * paddedWidth + x) + 1] = isPadding ? 0 : coverage[sourceY * width + sourceX];
+		}
+	}
+	MemFree(coverage);
+
+	int cellInPage = cell % GLYPH_CELLS_PER_PAGE;
+	Rectangle destination = {
+		(float)(cellInPage % GLYPH_CELLS_PER_ROW * GLYPH_CELL_SIZE),
+		(float)(cellInPage / GLYPH_CELLS_PER_ROW * GLYPH_CELL_SIZE),
+		(float)paddedWidth,
+		(float)paddedHeight
+	};
+	UpdateTextureRec(glyphPages[cell / GLYPH_CELLS_PER_PAGE], destination, pixels);
+	MemFree(pixels);
+	return cell;
+}
+
+static void RemoveFontFromGlyphCache(const GameFont *font)
+{
+	for (int i = 0; i < numGlyphCells; ++i)
+	{
+		if (glyphCells[i].font == font)
+		{
+			// Free cells go to the old end, so they get reused first.
+			glyphCells[i].font = NULL;
+			UnlinkGlyphCell(i);
+			LinkOldestGlyphCell(i);
+			--numCachedGlyphs;
+			++glyphCacheGeneration;
+		}
+	}
+}
+
+unsigned GetGlyphCacheGeneration(void)
+{
+	return glyphCacheGeneration;
+}
+
+int GetNumCachedGlyphs(void)
+{
+	return numCachedGlyphs;
+}
+
+int GetNumGlyphCachePages(void)
+{
+	return numGlyphPages;
+}
+
+// Adds the metrics of a glyph to the font and returns its index. Rounds the same way raylib's LoadFontData does, so text is laid out like it always was.
+static int AddFontGlyph(GameFont *font, int codepoint, int truetypeGlyph)
+{
+	float scale = font->truetypeScale;
+	int advance;
+	stbtt_GetGlyphHMetrics(font->truetype, truetypeGlyph, &advance, NULL);
+	int x0, y0, x1, y1;
+	stbtt_GetGlyphBitmapBox(font->truetype, truetypeGlyph, scale, scale, &x0, &y0, &x1, &y1);
+
+	// Glyphs that don't fit in a cell get cut off. Fonts just shouldn't be loaded that big.
+	int maxSize = GLYPH_CELL_SIZE - 2 * GLYPH_PADDING;
+
+	FontGlyph *glyph = ListAllocateItem(&font->glyphs);
+	glyph->codepoint = codepoint;
+	glyph->truetypeGlyph = truetypeGlyph;
+	glyph->box.x = (float)x0;
+	glyph->box.y = (float)(y0 + font->ascent);
+	glyph->box.width = (float)ClampInt(x1 - x0, 0, maxSize);
+	glyph->box.height = (float)ClampInt(y1 - y0, 0, maxSize);
+	glyph->advance = (float)(int)(advance * scale);
+	if (glyph->advance == 0)
+		glyph->advance = glyph->box.width;
+	glyph->cell = -1;
+	return ListCount(font->glyphs) - 1;
+}
+
+GameFont LoadGameFont(const char *path, int fontSize)
+{
+	GameFont font = { 0 };
+	int size = 0;
+	font.fileData = LoadAssetData(path, &size);
+	if (not font.fileData)
+	{
+		LogError("Failed to load font '%s'.", path);
+		return font;
+	}
+
+	font.truetype = MemAlloc(sizeof(stbtt_fontinfo));
+	if (not stbtt_InitFont(font.truetype, font.fileData, stbtt_GetFontOffsetForIndex(font.fileData, 0)))
+	{
+		LogError("Failed to load font '%s'.", path);
+		MemFree(font.truetype);
+		UnloadFileData(font.fileData);
+		ZeroBytes(&font, sizeof font);
+		return font;
+	}
+
+	int ascent;
+	stbtt_GetFontVMetrics(font.truetype, &ascent, NULL, NULL);
+	font.baseSize = fontSize;
+	font.truetypeScale = stbtt_ScaleForPixelHeight(font.truetype, (float)fontSize);
+	font.ascent = (int)(ascent * font.truetypeScale);
+
+	// ASCII is used all the time, so we look it up right away. Everything else is looked up the first time it's used.
+	for (int i = 0; i < COUNTOF(font.asciiGlyphs); ++i)
+		font.asciiGlyphs[i] = AddFontGlyph(&font, i, stbtt_FindGlyphIndex(font.truetype, i));
+
+	// Other codepoints the font doesn't have show up as '?', same as with raylib's GetGlyphIndex.
+	font.fallbackGlyph = font.asciiGlyphs['?'];
+	return font;
+}
+
+void UnloadGameFont(GameFont *font)
+{
+	RemoveFontFromGlyphCache(font);
+	MemFree(font->truetype);
+	UnloadFileData(font->fileData);
+	ListDestroy(&font->glyphs);
+	ListDestroy(&font->otherGlyphs);
+	ZeroBytes(font, sizeof font[0]);
+}
+
+int GetGameFontGlyphIndex(GameFont *font, int codepoint)
+{
+	if (codepoint >= 0 and codepoint < COUNTOF(font->asciiGlyphs))
+		return font->asciiGlyphs[codepoint];
+
+	int low = 0;
+	int high = ListCount(font->otherGlyphs);
+	while (low < high)
+	{
+		int middle = low + (high - low) / 2;
+		if (font->otherGlyphs[middle].codepoint < codepoint)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	if (low < ListCount(font->otherGlyphs) and font->otherGlyphs[low].codepoint == codepoint)
+		return font->otherGlyphs[low].glyphIndex;
+
+	// First time we see this codepoint. Codepoints the font doesn't have are remembered as well, so we don't look for them again.
+	int glyphIndex = font->fallbackGlyph;
+	int truetypeGlyph = stbtt_FindGlyphIndex(font->truetype, codepoint);
+	if (truetypeGlyph != 0)
+		glyphIndex = AddFontGlyph(font, codepoint, truetypeGlyph);
+
+	GlyphMapping mapping = { codepoint, glyphIndex };
+	ListAdd(&font->otherGlyphs, mapping);
+	int count = ListCount(font->otherGlyphs);
+	MoveBytes(&font->otherGlyphs[low + 1], &font->otherGlyphs[low], (count - 1 - low) * sizeof mapping);
+	font->otherGlyphs[low] = mapping;
+	return glyphIndex;
+}
+
+float GetGameFontAdvance(const GameFont *font, int glyphIndex, float fontSize)
+{
+	return font->glyphs[glyphIndex].advance * (fontSize / font->baseSize);
+}
+
+float GetLineHeight(const GameFont *font, float fontSize)
+{
+	return font->baseSize * (fontSize / font->baseSize);
+}
+
+GlyphQuad GetGlyphQuad(GameFont *font, int glyphIndex, float x, float y, float fontSize)
+{
+	float scaleFactor = fontSize / font->baseSize;
+	Rectangle box = font->glyphs[glyphIndex].box;
+
+	GlyphQuad quad = { 0 };
+	quad.cell = CacheGlyph(font, glyphIndex);
+	quad.destination.x = x + (box.x - GLYPH_PADDING) * scaleFactor;
+	quad.destination.y = y + (box.y - GLYPH_PADDING) * scaleFactor;
+	quad.destination.width = (box.width + 2 * GLYPH_PADDING) * scaleFactor;
+	quad.destination.height = (box.height + 2 * GLYPH_PADDING) * scaleFactor;
+	if (quad.cell >= 0)
+	{
+		int cellInPage = quad.cell % GLYPH_CELLS_PER_PAGE;
+		float u = (float)(cellInPage % GLYPH_CELLS_PER_ROW * GLYPH_CELL_SIZE);
+		float v = (float)(cellInPage / GLYPH_CELLS_PER_ROW * GLYPH_CELL_SIZE);
+		quad.uv0 = (Vector2){ u / GLYPH_PAGE_SIZE, v / GLYPH_PAGE_SIZE };
+		quad.uv1 = (Vector2){ (u + box.width + 2 * GLYPH_PADDING) / GLYPH_PAGE_SIZE, (v + box.height + 2 * GLYPH_PADDING) / GLYPH_PAGE_SIZE };
+	}
+	return quad;
+}
+
+void DrawGlyphQuads(const GlyphQuad *quads, int numQuads, Vector2 offset, Color color)
+{
+	// Quads that come one after another from the same page go in one batch.
+	int start = 0;
+	while (start < numQuads)
+	{
+		if (quads[start].cell < 0)
+		{
+			++start;
+			continue;
+		}
+
+		int page = quads[start].cell / GLYPH_CELLS_PER_PAGE;
+		int end = start + 1;
+		while (end < numQuads and (quads[end].cell < 0 or quads[end].cell / GLYPH_CELLS_PER_PAGE == page))
+			++end;
+
+		rlCheckRenderBatchLimit(4 * (end - start));
+		rlSetTexture(glyphPages[page].id);
+		rlBegin(RL_QUADS);
+		{
+			rlColor(color);
+			rlNormal3f(0, 0, 1);
+			for (int i = start; i < end; ++i)
+			{
+				GlyphQuad quad = quads[i];
+				if (quad.cell < 0)
+					continue;
+
+				TouchGlyphCell(quad.cell);
+				float x0 = offset.x + quad.destination.x;
+				float y0 = offset.y + quad.destination.y;
+				float x1 = x0 + quad.destination.width;
+				float y1 = y0 + quad.destination.height;
+				rlTexCoord2f(quad.uv0.x, quad.uv0.y);
+				rlVertex2f(x0, y0);
+				rlTexCoord2f(quad.uv0.x, quad.uv1.y);
+				rlVertex2f(x0, y1);
+				rlTexCoord2f(quad.uv1.x, quad.uv1.y);
+				rlVertex2f(x1, y1);
+				rlTexCoord2f(quad.uv1.x, quad.uv0.y);
+				rlVertex2f(x1, y0);
+			}
+		}
+		rlEnd();
+		rlSetTexture(0);
+		start = end;
+	}
+}
+
+// Lays out the string the same way DrawTextEx would. Returns the quads in temporary storage and also the size of the text.
+static GlyphQuad *LayoutString(GameFont *font, const char *string, float fontSize, int *outNumQuads, Vector2 *outSize)
+{
+	float lineAdvance = 1.5f * font->baseSize * (fontSize / font->baseSize);
+	int length = StringLength(string);
+	GlyphQuad *quads = TempAlloc(length * sizeof quads[0]);
+	int numQuads = 0;
+
+	float x = 0;
+	float y = 0;
+	float width = 0;
+	for (int i = 0; i < length;)
+	{
+		int numBytes = 0;
+		int codepoint = GetCodepoint(string + i, &numBytes);
+		i += numBytes;
+
+		if (codepoint == '\n')
+		{
+			x = 0;
+			y += lineAdvance;
+			continue;
+		}
+
+		int index = GetGameFontGlyphIndex(font, codepoint);
+		if (codepoint != ' ' and codepoint != '\t')
+			quads[numQuads++] = GetGlyphQuad(font, index, x, y, fontSize);
+		x += GetGameFontAdvance(font, index, fontSize);
+		width = fmaxf(width, x);
+	}
+
+	*outNumQuads = numQuads;
+	outSize->x = width;
+	outSize->y = y + fontSize;
+	return quads;
+}
+
+void DrawFormat(GameFont *font, float x, float y, float fontSize, Color color, FORMAT_STRING format, ...)
 {
 	va_list args;
 	va_start(args, format);
@@ -21,19 +447,23 @@ void DrawFormat(Font font, float x, float y, float fontSize, Color color, FORMAT
 	va_end(args);
 }
 
-void DrawFormatVa(Font font, float x, float y, float fontSize, Color color, FORMAT_STRING format, va_list args)
+void DrawFormatVa(GameFont *font, float x, float y, float fontSize, Color color, FORMAT_STRING format, va_list args)
 {
+	if (not font->truetype)
+		return;
+
 	int mark = TempMark();
 	{
 		char *string = TempFormatVa(format, args);
-		Vector2 pos = { x, y };
-		Vector2 origin = { 0 };
-		DrawTextPro(font, string, pos, origin, 0, fontSize, 0, color);
+		int numQuads;
+		Vector2 size;
+		GlyphQuad *quads = LayoutString(font, string, fontSize, &numQuads, &size);
+		DrawGlyphQuads(quads, numQuads, (Vector2){ x, y }, color);
 	}
 	TempReset(mark);
 }
 
-void DrawFormatCentered(Font font, float x, float y, float fontSize, Color color, FORMAT_STRING format, ...)
+void DrawFormatCentered(GameFont *font, float x, float y, float fontSize, Color color, FORMAT_STRING format, ...)
 {
 	va_list args;
 	va_start(args, format);
@@ -41,15 +471,18 @@ void DrawFormatCentered(Font font, float x, float y, float fontSize, Color color
 	va_end(args);
 }
 
-void DrawFormatCenteredVa(Font font, float x, float y, float fontSize, Color color, FORMAT_STRING format, va_list args)
+void DrawFormatCenteredVa(GameFont *font, float x, float y, float fontSize, Color color, FORMAT_STRING format, va_list args)
 {
+	if (not font->truetype)
+		return;
+
 	int mark = TempMark();
 	{
 		char *string = TempFormatVa(format, args);
-		Vector2 size = MeasureTextEx(font, string, fontSize, 0);
-		Vector2 pos = { x - size.x / 2, y - size.y / 2 };
-		Vector2 origin = { 0 };
-		DrawTextPro(font, string, pos, origin, 0, fontSize, 0, color);
+		int numQuads;
+		Vector2 size;
+		GlyphQuad *quads = LayoutString(font, string, fontSize, &numQuads, &size);
+		DrawGlyphQuads(quads, numQuads, (Vector2){ x - size.x / 2, y - size.y / 2 }, color);
 	}
 	TempReset(mark);
 }
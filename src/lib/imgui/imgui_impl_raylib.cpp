@@ -1,10 +1,39 @@
 #include "imgui_impl_raylib.h"
 #include "../../lib/raylib.h"
 #include "../../lib/rlgl.h"
+#include "../../lib/raymath.h"
 
 static double g_Time = 0.0;
 static bool g_UnloadAtlas = false;
 static int g_AtlasTexID = 0;
+static bool g_VaoCreated = false;
+static unsigned int g_VaoId = 0; // Stays 0 if the platform doesn't support VAOs (WebGL 1).
+static unsigned int g_VboId = 0;
+static unsigned int g_EboId = 0;
+static int g_VboSize = 0;
+static int g_EboSize = 0;
+static ImGui_ImplRaylib_RenderStats g_Stats;
+
+// Makes sure the GPU buffers can hold at least the given number of bytes. They only ever grow.
+static void ImGui_ImplRaylib_ReserveBuffers(int vtx_bytes, int idx_bytes)
+{
+    if (vtx_bytes > g_VboSize)
+    {
+        while (g_VboSize < vtx_bytes)
+            g_VboSize = g_VboSize ? 2 * g_VboSize : vtx_bytes;
+        if (g_VboId)
+            rlUnloadVertexBuffer(g_VboId);
+        g_VboId = rlLoadVertexBuffer(NULL, g_VboSize, true);
+    }
+    if (idx_bytes > g_EboSize)
+    {
+        while (g_EboSize < idx_bytes)
+            g_EboSize = g_EboSize ? 2 * g_EboSize : idx_bytes;
+        if (g_EboId)
+            rlUnloadVertexBuffer(g_EboId);
+        g_EboId = rlLoadVertexBufferElement(NULL, g_EboSize, true);
+    }
+}
 
 static const char* ImGui_ImplRaylib_GetClipboardText(void*)
 {
@@ -60,6 +89,15 @@ void ImGui_ImplRaylib_Shutdown()
         ImGuiIO& io = ImGui::GetIO();
         io.Fonts->ClearTexData();
     }
+    if (g_VboId)
+        rlUnloadVertexBuffer(g_VboId);
+    if (g_EboId)
+        rlUnloadVertexBuffer(g_EboId);
+    if (g_VaoId)
+        rlUnloadVertexArray(g_VaoId);
+    g_VaoId = g_VboId = g_EboId = 0;
+    g_VaoCreated = false;
+    g_VboSize = g_EboSize = 0;
     g_Time = 0.0;
 }
 
@@ -255,70 +293,105 @@ void ImGui_ImplRaylib_LoadDefaultFontAtlas()
     }
 };
 
-//  Code originally provided by WEREMSOFT.
+// ImGui already gives us a vertex and an index buffer per draw list, so instead of going through
+// raylib's immediate mode batcher one triangle at a time, we upload them to our own GPU buffers
+// and issue one glDrawElements per ImDrawCmd, using raylib's default shader.
 void ImGui_ImplRaylib_Render(ImDrawData* draw_data)
 {
+    g_Stats = ImGui_ImplRaylib_RenderStats();
+
+    int fb_width = GetRenderWidth();
+    int fb_height = GetRenderHeight();
+    if (fb_width <= 0 || fb_height <= 0 || draw_data->DisplaySize.x <= 0 || draw_data->DisplaySize.y <= 0)
+        return;
+
+    // Everything raylib batched so far has to be drawn before we start issuing our own draw calls.
+    rlDrawRenderBatchActive();
+
+    if (!g_VaoCreated)
+    {
+        g_VaoId = rlLoadVertexArray();
+        g_VaoCreated = true;
+    }
 
-    auto DrawTriangleVertex = [](ImDrawVert idx_vert) -> void {
-        Color* c = (Color*)&idx_vert.col;
-        rlColor4ub(c->r, c->g, c->b, c->a);
-        rlTexCoord2f(idx_vert.uv.x, idx_vert.uv.y);
-        rlVertex2f(idx_vert.position.x, idx_vert.position.y);
-    };
+    ImVec2 clip_off = draw_data->DisplayPos;
+    ImVec2 clip_scale = ImVec2(fb_width / draw_data->DisplaySize.x, fb_height / draw_data->DisplaySize.y);
+    float left = draw_data->DisplayPos.x;
+    float right = draw_data->DisplayPos.x + draw_data->DisplaySize.x;
+    float top = draw_data->DisplayPos.y;
+    float bottom = draw_data->DisplayPos.y + draw_data->DisplaySize.y;
+    Matrix projection = MatrixOrtho(left, right, bottom, top, -1, 1);
+
+    unsigned int shader = rlGetShaderIdDefault();
+    int* locs = rlGetShaderLocsDefault();
+    float white[4] = { 1, 1, 1, 1 };
+    int texture_slot = 0;
 
     rlDisableBackfaceCulling();
+    rlEnableShader(shader);
+    rlSetUniformMatrix(locs[RL_SHADER_LOC_MATRIX_MVP], projection);
+    rlSetUniform(locs[RL_SHADER_LOC_COLOR_DIFFUSE], white, RL_SHADER_UNIFORM_VEC4, 1);
+    rlSetUniform(locs[RL_SHADER_LOC_MAP_DIFFUSE], &texture_slot, RL_SHADER_UNIFORM_INT, 1);
+    rlActiveTextureSlot(0);
+    rlEnableScissorTest();
+
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        const ImDrawVert* vtx_buffer = cmd_list->VtxBuffer.Data; // vertex buffer generated by Dear ImGui
-        const ImDrawIdx* idx_buffer = cmd_list->IdxBuffer.Data;  // index buffer generated by Dear ImGui
+        int vtx_bytes = cmd_list->VtxBuffer.Size * (int)sizeof(ImDrawVert);
+        int idx_bytes = cmd_list->IdxBuffer.Size * (int)sizeof(ImDrawIdx);
+
+        // The attribute pointers need to be set with the buffers bound, and the element buffer
+        // binding is part of the VAO state, so we (re)bind everything for every draw list.
+        rlEnableVertexArray(g_VaoId);
+        ImGui_ImplRaylib_ReserveBuffers(vtx_bytes, idx_bytes);
+        rlEnableVertexBuffer(g_VboId);
+        rlUpdateVertexBuffer(g_VboId, cmd_list->VtxBuffer.Data, vtx_bytes, 0);
+        rlEnableVertexBufferElement(g_EboId);
+        rlUpdateVertexBufferElements(g_EboId, cmd_list->IdxBuffer.Data, idx_bytes, 0);
+
+        rlSetVertexAttribute(locs[RL_SHADER_LOC_VERTEX_POSITION], 2, RL_FLOAT, false, sizeof(ImDrawVert), (void*)IM_OFFSETOF(ImDrawVert, position));
+        rlEnableVertexAttribute(locs[RL_SHADER_LOC_VERTEX_POSITION]);
+        rlSetVertexAttribute(locs[RL_SHADER_LOC_VERTEX_TEXCOORD01], 2, RL_FLOAT, false, sizeof(ImDrawVert), (void*)IM_OFFSETOF(ImDrawVert, uv));
+        rlEnableVertexAttribute(locs[RL_SHADER_LOC_VERTEX_TEXCOORD01]);
+        rlSetVertexAttribute(locs[RL_SHADER_LOC_VERTEX_COLOR], 4, RL_UNSIGNED_BYTE, true, sizeof(ImDrawVert), (void*)IM_OFFSETOF(ImDrawVert, col));
+        rlEnableVertexAttribute(locs[RL_SHADER_LOC_VERTEX_COLOR]);
+
+        g_Stats.Vertices += cmd_list->VtxBuffer.Size;
+        g_Stats.Indices += cmd_list->IdxBuffer.Size;
+
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
         {
-            const ImDrawCmd* pcmd = &(cmd_list->CmdBuffer.Data)[cmd_i]; // cmd_list->CmdBuffer->data[cmd_i];
+            const ImDrawCmd* pcmd = &cmd_list->CmdBuffer.Data[cmd_i];
             if (pcmd->UserCallback)
             {
                 pcmd->UserCallback(cmd_list, pcmd);
+                continue;
             }
-            else
-            {
-                ImVec2 position = draw_data->DisplayPos;
-                int rectX = (int)(pcmd->ClipRect.x - position.x);
-                int rectY = (int)(pcmd->ClipRect.y - position.y);
-                int rectW = (int)(pcmd->ClipRect.z - rectX);
-                int rectH = (int)(pcmd->ClipRect.w - rectY);
-                BeginScissorMode(rectX, rectY, rectW, rectH);
-                {
-                    unsigned int* ti = (unsigned int*)pcmd->TextureId;
-                    for (unsigned int i = 0; i <= (pcmd->ElemCount - 3); i += 3)
-                    {
-                        rlPushMatrix();
-                        rlBegin(RL_TRIANGLES);
-                        rlSetTexture(*ti);
-
-                        ImDrawIdx index;
-                        ImDrawVert vertex;
-
-                        index = idx_buffer[i];
-                        vertex = vtx_buffer[index];
-                        DrawTriangleVertex(vertex);
-
-                        index = idx_buffer[i + 2];
-                        vertex = vtx_buffer[index];
-                        DrawTriangleVertex(vertex);
-
-                        index = idx_buffer[i + 1];
-                        vertex = vtx_buffer[index];
-                        DrawTriangleVertex(vertex);
-
-                        rlDisableTexture();
-                        rlEnd();
-                        rlPopMatrix();
-                    }
-                }
-            }
-            idx_buffer += pcmd->ElemCount;
+
+            ImVec2 clip_min((pcmd->ClipRect.x - clip_off.x) * clip_scale.x, (pcmd->ClipRect.y - clip_off.y) * clip_scale.y);
+            ImVec2 clip_max((pcmd->ClipRect.z - clip_off.x) * clip_scale.x, (pcmd->ClipRect.w - clip_off.y) * clip_scale.y);
+            if (clip_max.x <= clip_min.x || clip_max.y <= clip_min.y || pcmd->ElemCount == 0)
+                continue;
+
+            // OpenGL's scissor rectangle starts at the bottom left of the framebuffer.
+            rlScissor((int)clip_min.x, (int)(fb_height - clip_max.y), (int)(clip_max.x - clip_min.x), (int)(clip_max.y - clip_min.y));
+            rlEnableTexture(*(unsigned int*)pcmd->TextureId);
+            rlDrawVertexArrayElements((int)pcmd->IdxOffset, (int)pcmd->ElemCount, 0);
+            g_Stats.DrawCalls++;
         }
     }
-    EndScissorMode();
+
+    rlDisableScissorTest();
+    rlDisableTexture();
+    rlDisableVertexArray();
+    rlDisableVertexBuffer();
+    rlDisableVertexBufferElement();
+    rlDisableShader();
     rlEnableBackfaceCulling();
-}
\ No newline at end of file
+}
+
+ImGui_ImplRaylib_RenderStats ImGui_ImplRaylib_GetRenderStats()
+{
+    return g_Stats;
+}
@@ -15,11 +15,20 @@
 extern "C" {
 #endif
 
+	// Counted during the last ImGui_ImplRaylib_Render call.
+	struct ImGui_ImplRaylib_RenderStats
+	{
+		int DrawCalls;
+		int Vertices;
+		int Indices;
+	};
+
 	IMGUI_IMPL_API bool ImGui_ImplRaylib_Init();
 	IMGUI_IMPL_API void ImGui_ImplRaylib_Shutdown();
 	IMGUI_IMPL_API void ImGui_ImplRaylib_NewFrame();
 	IMGUI_IMPL_API void ImGui_ImplRaylib_LoadDefaultFontAtlas();
 	IMGUI_IMPL_API void ImGui_ImplRaylib_Render(ImDrawData* draw_data);
+	IMGUI_IMPL_API ImGui_ImplRaylib_RenderStats ImGui_ImplRaylib_GetRenderStats();
 
 #if defined(__cplusplus)
 }
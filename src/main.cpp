@@ -1,4 +1,5 @@
 #include "core.h"
+#include "lib/imgui/imgui_impl_raylib.h"
 
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 720
@@ -9,11 +10,23 @@
 #define DEFAULT_CAMERA_SHAKE_TRAUMA 0.5f
 #define DEFAULT_CAMERA_SHAKE_FALLOFF (0.7f * FRAME_TIME)
 #define SCENE_MAGIC "KEKW"
-#define SCENE_VERSION 5 // You need to increase this every time the scene binary format changes!
+#define SCENE_VERSION 6 // Only increase this if the header or table of contents change. Chunks have their own versions.
+#define SCENE_LEGACY_VERSION 5 // The last version before scenes were split into chunks.
+#define SCENE_CHUNK_OBJECTS "OBJS"
+#define SCENE_CHUNK_STAIRS "STRS"
+#define SCENE_CHUNK_DEPENDENCIES "DEPS"
+#define SCENE_OBJECTS_VERSION 1 // You need to increase this every time the objects chunk format changes!
+#define SCENE_STAIRS_VERSION 1 // You need to increase this every time the stairs chunk format changes!
+#define SCENE_DEPENDENCIES_VERSION 1 // You need to increase this every time the dependencies chunk format changes!
+#define ASSET_PACK_PATH "assets.pack"
+#define MAX_EXPRESSIONS 10 // We might want more, but this should generally be a very small number.
+#define MAX_STAIRS 100
 #define Y_SQUISH 0.5773502691896258f // 1 / (2 * cos(30 degrees)) = 1 / sqrt(3)
 #define GRID_RESOLUTION_X 50.0f
 #define GRID_RESOLUTION_Y (GRID_RESOLUTION_X * Y_SQUISH)
 #define ELEVATION_TO_Y_OFFSET (-GRID_RESOLUTION_Y / 2)
+#define SPATIAL_CELL_SIZE 256.0f
+#define SPATIAL_NUM_BUCKETS 1024 // Must be a power of 2.
 
 ENUM(GameState)
 {
@@ -100,24 +113,52 @@ STRUCT(MotionMaster)
 	float speed = 10;
 };
 
+// Objects are split in two. Everything that's touched every frame (updating, drawing, sorting, collisions, talk checks)
+// is in Object, and those are packed together in the objects list. Everything that only dialog and the
+// editor need is in ObjectInfo, in the objectInfos list. Both lists always have the same length, and objectInfos[i]
+// belongs to objects[i], see GetInfo.
 STRUCT(Object)
 {
-	char name[50];
 	Vector2 position;
 	float zOffset;
+	float zKey; // Cached foot position + zOffset that we sort by. Only valid if zKeyIsStale is false.
+	bool zKeyIsStale; // Set this whenever the position, zOffset, or current sprite frame changes.
+	bool autoTalkInRange;
 	Direction direction;
-	Sprite *sprites[DIRECTION_ENUM_COUNT];
+	int animationFrame;
 	float animationFps;
 	float animationTimeAccumulator;
 	float talkRange;
-	bool autoTalkInRange;
-	int animationFrame;
-	Image *collisionMap;
-	Script *script;
-	Expression expressions[10]; // We might want more, but this should generally be a very small number.
+	int cellX0, cellY0, cellX1, cellY1; // Range of spatial grid cells the object is in (inclusive).
+	int queryStamp; // Used to avoid returning the same object twice from a spatial query.
+	CollisionMask *collisionMap;
+	Sprite *sprites[DIRECTION_ENUM_COUNT];
 	MotionMaster motionMaster;
 };
 
+STRUCT(ObjectInfo)
+{
+	int slot; // Which objectSlots entry points to this object.
+	char name[50];
+	Script *script;
+	Expression expressions[MAX_EXPRESSIONS];
+};
+
+// Refers to an object without pointing into the objects list, which moves around whenever objects are added or removed.
+// Goes through objectSlots, which always knows where each object is. Removing an object bumps its slot's generation,
+// so old handles to it resolve to NULL instead of to whatever object ends up in its place. A zeroed handle is always NULL.
+STRUCT(ObjectHandle)
+{
+	int slot;
+	int generation;
+};
+
+STRUCT(ObjectSlot)
+{
+	int index; // Index into the objects list if the slot is in use, otherwise the next free slot (or -1).
+	int generation; // Starts at 1, and goes up every time the slot is freed.
+};
+
 STRUCT(Stair)
 {
 	int x0;
@@ -140,105 +181,164 @@ STRUCT(Options)
 
 Options options;
 Input input;
-Font roboto;
-Font robotoBold;
-Font robotoItalic;
-Font robotoBoldItalic;
-Object objects[100];
-Object *player = &objects[0]; // The player is ALWAYS the first object.
-int numObjects;
+GameFont roboto;
+GameFont robotoBold;
+GameFont robotoItalic;
+GameFont robotoBoldItalic;
+List(Object) objects;
+List(ObjectInfo) objectInfos;
+Object *player; // The player is ALWAYS the first object. Objects move around in memory when they are added or removed, see InsertObject.
+List(ObjectSlot) objectSlots;
+int firstFreeObjectSlot = -1;
 Camera2D camera;
 float cameraTrauma; // Amount of camera shake. Will slowly decrease over time.
 float cameraTraumaFalloff; // How quickly the camera shake stops.
 Vector2 cameraOffset1;
 Vector2 cameraOffset2;
 int numStairs;
-Stair stairs[100];
+Stair stairs[MAX_STAIRS];
+List(Object *) drawOrder; // Objects sorted front-to-back by zKey. Kept up to date by GetZSortedObjects.
+bool drawOrderIsStale = true; // Set this whenever objects are added to, removed from, or moved around in the objects array.
+int drawOrderAssetReloads; // Sprites can change size when they are hot-reloaded, so we re-key everything when that happens.
 
-bool CheckCollisionMap(Image map, Vector2 position)
+STRUCT(CellEntry)
 {
-	int xi = (int)floorf(position.x);
-	int yi = (int)floorf(position.y);
+	int cellX;
+	int cellY;
+	Object *object;
+};
 
-	if (xi < 0)
-		return false;
-	if (xi >= map.width)
-		return false;
-	if (yi < 0)
-		return false;
-	if (yi >= map.height)
-		return false;
+// Uniform grid over the world that lets us find objects near a point without looking at all of them.
+// Objects are put in every cell that their bounds overlap. Cells are hashed into a fixed number of buckets,
+// so the grid doesn't care how big the world is.
+STRUCT(SpatialGrid)
+{
+	List(CellEntry) buckets[SPATIAL_NUM_BUCKETS];
+	bool isStale; // Set this whenever objects are added to, removed from, or moved around in the objects array.
+	int assetReloads; // Sprites and collision maps can change size when hot-reloaded.
+	int queryStamp;
+	float maxTalkRange;
+};
+SpatialGrid spatialGrid = { { 0 }, true };
 
-	Color color = GetImageColor(map, xi, yi);
-	return color.r < 128;
+int GetObjectIndex(const Object *object)
+{
+	ASSERT(object >= objects and object < objects + ListCount(objects));
+	return (int)(object - objects);
 }
-Vector2 MovePointWithCollisions(Vector2 position, Vector2 velocity)
+ObjectInfo *GetInfo(const Object *object)
 {
-	Vector2 p0 = position;
-	Vector2 p1 = position + velocity;
-	
-	Vector2 newPosition = position + velocity;
-	for (int i = 0; i < numObjects; ++i)
+	return &objectInfos[GetObjectIndex(object)];
+}
+ObjectHandle GetObjectHandle(const Object *object)
+{
+	ObjectHandle handle = { 0 };
+	if (object)
 	{
-		Object *object = &objects[i];
-		if (object->collisionMap)
-		{
-			Rectangle rectangle = {
-				object->position.x - 0.5f * object->collisionMap->width,
-				object->position.y - 0.5f * object->collisionMap->height,
-				(float)object->collisionMap->width,
-				(float)object->collisionMap->height,
-			};
-			Vector2 topLeft = { rectangle.x, rectangle.y };
-			Vector2 localPosition = newPosition - topLeft;
-
-			// The CheckCollisionMap call might become more expensive in the future, so we first check
-			// the rectangle to make sure a collision can happen at all, and only then do we actually check the collision map.
-			if (CheckCollisionPointRec(newPosition, rectangle) and CheckCollisionMap(*object->collisionMap, localPosition))
-				return position;
-		}
+		handle.slot = GetInfo(object)->slot;
+		handle.generation = objectSlots[handle.slot].generation;
 	}
+	return handle;
+}
+// Returns NULL if the object was removed. The pointer is only valid until objects are added or removed.
+Object *ResolveObjectHandle(ObjectHandle handle)
+{
+	if (handle.slot < 0 or handle.slot >= ListCount(objectSlots))
+		return NULL;
 
-	return newPosition;
+	ObjectSlot slot = objectSlots[handle.slot];
+	if (slot.generation != handle.generation)
+		return NULL;
+	return &objects[slot.index];
 }
+int AllocateObjectSlot(int index)
+{
+	int slot = firstFreeObjectSlot;
+	if (slot >= 0)
+		firstFreeObjectSlot = objectSlots[slot].index;
+	else
+	{
+		slot = ListCount(objectSlots);
+		ObjectSlot *newSlot = ListAllocateItem(&objectSlots);
+		newSlot->generation = 1;
+	}
+	objectSlots[slot].index = index;
+	return slot;
+}
+void FreeObjectSlot(int slot)
+{
+	++objectSlots[slot].generation;
+	objectSlots[slot].index = firstFreeObjectSlot;
+	firstFreeObjectSlot = slot;
+}
+// Call this after objects are added or removed, starting from the given index. Any pointers to objects are invalid after that.
+void OnObjectsChanged(int firstChangedIndex)
+{
+	for (int i = firstChangedIndex; i < ListCount(objects); ++i)
+		objectSlots[objectInfos[i].slot].index = i;
 
+	player = ListCount(objects) > 0 ? &objects[0] : NULL;
+	drawOrderIsStale = true;
+	spatialGrid.isStale = true;
+}
+// Inserts a zeroed object at the given index, and shifts all objects after it up by one.
+Object *InsertObject(int index)
+{
+	ASSERT(index >= 0 and index <= ListCount(objects));
+	ListAllocateItem(&objects);
+	ListAllocateItem(&objectInfos);
+
+	int numAfter = ListCount(objects) - index - 1;
+	MoveBytes(&objects[index + 1], &objects[index], numAfter * sizeof objects[0]);
+	MoveBytes(&objectInfos[index + 1], &objectInfos[index], numAfter * sizeof objectInfos[0]);
+	ZeroBytes(&objects[index], sizeof objects[0]);
+	ZeroBytes(&objectInfos[index], sizeof objectInfos[0]);
+	objectInfos[index].slot = AllocateObjectSlot(index);
+
+	OnObjectsChanged(index);
+	return &objects[index];
+}
 Object *FindObjectByName(const char *name)
 {
-	for (int i = 0; i < numObjects; ++i)
-		if (StringsEqualNocase(objects[i].name, name))
+	for (int i = 0; i < ListCount(objects); ++i)
+		if (StringsEqualNocase(objectInfos[i].name, name))
 			return &objects[i];
 
 	return NULL;
 }
 Texture *GetCharacterPortrait(const Object *object, const char *name)
 {
-	for (int i = 0; i < COUNTOF(object->expressions); ++i)
-		if (StringsEqualNocase(object->expressions[i].name, name))
-			return object->expressions[i].portrait;
-	return object->expressions[0].portrait;
+	ObjectInfo *info = GetInfo(object);
+	for (int i = 0; i < COUNTOF(info->expressions); ++i)
+		if (StringsEqualNocase(info->expressions[i].name, name))
+			return info->expressions[i].portrait;
+	return info->expressions[0].portrait;
 }
 Sprite *GetCurrentSprite(const Object *object)
 {
 	Sprite *sprite = object->sprites[object->direction];
 	if (not sprite)
 		sprite = object->sprites[MirrorDirectionVertically(object->direction)];
+	if (sprite and sprite->numFrames == 0)
+		return NULL; // Still loading.
 	return sprite;
 }
-Texture *GetCurrentTexture(const Object *object)
+SpriteFrame *GetCurrentFrame(const Object *object)
 {
 	Sprite *sprite = GetCurrentSprite(object);
 	if (not sprite)
 		return NULL;
 
-	return &sprite->frames[object->animationFrame];
+	// The sprite could have been reloaded with fewer frames.
+	return &sprite->frames[object->animationFrame % sprite->numFrames];
 }
 Vector2 GetFootPositionInScreenSpace(const Object *object)
 {
 	Vector2 position = object->position;
 
-	Texture *objectTexture = GetCurrentTexture(object);
-	if (objectTexture)
-		position.y += objectTexture->height * 0.5f;
+	SpriteFrame *frame = GetCurrentFrame(object);
+	if (frame)
+		position.y += frame->source.height * 0.5f;
 
 	return position;
 }
@@ -256,61 +356,351 @@ float DistanceBetween(const Object *a, const Object *b)
 }
 Rectangle GetOutline(const Object *object)
 {
-	Texture *texture = GetCurrentTexture(object);
-	if (not texture)
+	SpriteFrame *frame = GetCurrentFrame(object);
+	if (not frame)
 	{
 		Rectangle empty = { 0 };
 		return empty;
 	}
 
 	Rectangle outline = {
-		object->position.x - 0.5f * texture->width,
-		object->position.y - 0.5f * texture->height,
-		(float)texture->width,
-		(float)texture->height,
+		object->position.x - 0.5f * frame->source.width,
+		object->position.y - 0.5f * frame->source.height,
+		frame->source.width,
+		frame->source.height,
 	};
 	return outline;
 }
+float ComputeZKey(const Object *object)
+{
+	return GetFootPositionInScreenSpace(object).y + object->zOffset;
+}
+// Sorts objects front-to-back (descending zKey) with 4 passes of an 8-bit LSD radix sort.
+// This is what we use when there is no previous order to start from.
+void RadixSortByZKey(Object **objects, int count)
+{
+	STRUCT(Item) { unsigned key; Object *object; };
+
+	int mark = TempMark();
+	{
+		Item *items = (Item *)TempAlloc(count * sizeof(Item));
+		Item *scratch = (Item *)TempAlloc(count * sizeof(Item));
+		for (int i = 0; i < count; ++i)
+		{
+			// Flip the float bits so that they sort as unsigned integers, then invert them so we sort in descending order.
+			unsigned bits;
+			CopyBytes(&bits, &objects[i]->zKey, sizeof bits);
+			bits ^= (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+			items[i].key = ~bits;
+			items[i].object = objects[i];
+		}
+
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			int offsets[256] = { 0 };
+			for (int i = 0; i < count; ++i)
+				++offsets[(items[i].key >> shift) & 0xFF];
+
+			int total = 0;
+			for (int i = 0; i < 256; ++i)
+			{
+				int digitCount = offsets[i];
+				offsets[i] = total;
+				total += digitCount;
+			}
+
+			for (int i = 0; i < count; ++i)
+				scratch[offsets[(items[i].key >> shift) & 0xFF]++] = items[i];
+
+			Item *swap = items;
+			items = scratch;
+			scratch = swap;
+		}
+
+		for (int i = 0; i < count; ++i)
+			objects[i] = items[i].object;
+	}
+	TempReset(mark);
+}
+// Sorts objects front-to-back (descending zKey). Objects barely move between frames, so the previous
+// frame's order is almost sorted already, and insertion sort fixes it up in close to linear time.
+void InsertionSortByZKey(Object **objects, int count)
+{
+	for (int i = 1; i < count; ++i)
+	{
+		Object *object = objects[i];
+		int j = i - 1;
+		while (j >= 0 and objects[j]->zKey < object->zKey)
+		{
+			objects[j + 1] = objects[j];
+			--j;
+		}
+		objects[j + 1] = object;
+	}
+}
+// Returns all objects sorted front-to-back. The returned list is owned by us and is valid until objects are added or removed.
 List(Object *) GetZSortedObjects(void)
 {
+	PROFILE_SCOPE("GetZSortedObjects");
+	int numObjects = ListCount(objects);
+	if (drawOrderIsStale or ListCount(drawOrder) != numObjects or drawOrderAssetReloads != GetNumAssetReloads())
+	{
+		ListClear(&drawOrder);
+		Object **pointers = ListAllocate(&drawOrder, numObjects);
+		for (int i = 0; i < numObjects; ++i)
+		{
+			Object *object = &objects[i];
+			object->zKey = ComputeZKey(object);
+			object->zKeyIsStale = false;
+			pointers[i] = object;
+		}
+
+		RadixSortByZKey(drawOrder, numObjects);
+		drawOrderIsStale = false;
+		drawOrderAssetReloads = GetNumAssetReloads();
+	}
+	else
+	{
+		for (int i = 0; i < numObjects; ++i)
+		{
+			Object *object = drawOrder[i];
+			if (object->zKeyIsStale)
+			{
+				object->zKey = ComputeZKey(object);
+				object->zKeyIsStale = false;
+			}
+		}
+
+		InsertionSortByZKey(drawOrder, numObjects);
+	}
+
+	return drawOrder;
+}
+// Returns the rectangle that contains both the object's sprite, and its collision map.
+Rectangle GetBounds(const Object *object)
+{
+	Rectangle bounds = GetOutline(object);
+	if (bounds.width == 0 and bounds.height == 0)
+	{
+		bounds.x = object->position.x;
+		bounds.y = object->position.y;
+	}
+
+	if (object->collisionMap)
+	{
+		float x0 = fminf(bounds.x, object->position.x - 0.5f * object->collisionMap->width);
+		float y0 = fminf(bounds.y, object->position.y - 0.5f * object->collisionMap->height);
+		float x1 = fmaxf(bounds.x + bounds.width, object->position.x + 0.5f * object->collisionMap->width);
+		float y1 = fmaxf(bounds.y + bounds.height, object->position.y + 0.5f * object->collisionMap->height);
+		bounds.x = x0;
+		bounds.y = y0;
+		bounds.width = x1 - x0;
+		bounds.height = y1 - y0;
+	}
+
+	return bounds;
+}
+int GetCellCoordinate(float x)
+{
+	return (int)floorf(x / SPATIAL_CELL_SIZE);
+}
+List(CellEntry) *GetCellBucket(int cellX, int cellY)
+{
+	unsigned hash = ((unsigned)cellX * 73856093u) ^ ((unsigned)cellY * 19349663u);
+	return &spatialGrid.buckets[hash & (SPATIAL_NUM_BUCKETS - 1)];
+}
+void InsertIntoSpatialGrid(Object *object)
+{
+	Rectangle bounds = GetBounds(object);
+	object->cellX0 = GetCellCoordinate(bounds.x);
+	object->cellY0 = GetCellCoordinate(bounds.y);
+	object->cellX1 = GetCellCoordinate(bounds.x + bounds.width);
+	object->cellY1 = GetCellCoordinate(bounds.y + bounds.height);
+	for (int y = object->cellY0; y <= object->cellY1; ++y)
+	{
+		for (int x = object->cellX0; x <= object->cellX1; ++x)
+		{
+			CellEntry entry = { x, y, object };
+			ListAdd(GetCellBucket(x, y), entry);
+		}
+	}
+
+	spatialGrid.maxTalkRange = fmaxf(spatialGrid.maxTalkRange, object->talkRange);
+}
+void RemoveFromSpatialGrid(Object *object)
+{
+	for (int y = object->cellY0; y <= object->cellY1; ++y)
+	{
+		for (int x = object->cellX0; x <= object->cellX1; ++x)
+		{
+			List(CellEntry) *bucket = GetCellBucket(x, y);
+			for (int i = 0; i < ListCount(*bucket); ++i)
+			{
+				CellEntry *entry = &(*bucket)[i];
+				if (entry->object == object and entry->cellX == x and entry->cellY == y)
+				{
+					ListSwapRemove(bucket, i);
+					break;
+				}
+			}
+		}
+	}
+}
+void RebuildSpatialGridIfStale(void)
+{
+	if (not spatialGrid.isStale and spatialGrid.assetReloads == GetNumAssetReloads())
+		return;
+
+	for (int i = 0; i < SPATIAL_NUM_BUCKETS; ++i)
+		ListClear(&spatialGrid.buckets[i]);
+	spatialGrid.maxTalkRange = 0;
+	for (int i = 0; i < ListCount(objects); ++i)
+		InsertIntoSpatialGrid(&objects[i]);
+
+	spatialGrid.isStale = false;
+	spatialGrid.assetReloads = GetNumAssetReloads();
+}
+// Call this whenever an object's position, zOffset, or current sprite frame changes. Keeps the draw order and spatial grid up to date.
+void MarkObjectAsMoved(Object *object)
+{
+	object->zKeyIsStale = true;
+	if (spatialGrid.isStale)
+		return; // Everything will be reinserted anyway.
+
+	Rectangle bounds = GetBounds(object);
+	bool changedCells =
+		GetCellCoordinate(bounds.x) != object->cellX0 or
+		GetCellCoordinate(bounds.y) != object->cellY0 or
+		GetCellCoordinate(bounds.x + bounds.width) != object->cellX1 or
+		GetCellCoordinate(bounds.y + bounds.height) != object->cellY1;
+	if (changedCells)
+	{
+		RemoveFromSpatialGrid(object);
+		InsertIntoSpatialGrid(object);
+	}
+	spatialGrid.maxTalkRange = fmaxf(spatialGrid.maxTalkRange, object->talkRange);
+}
+// Returns every object whose bounds overlap the rectangle. The result is allocated from temporary storage.
+List(Object *) QueryObjectsInRectangle(Rectangle rectangle)
+{
+	RebuildSpatialGridIfStale();
+
+	List(Object *) result = NULL;
+	ListSetAllocator((void **)&result, TempRealloc, TempFree);
+
+	int stamp = ++spatialGrid.queryStamp;
+	int x0 = GetCellCoordinate(rectangle.x);
+	int y0 = GetCellCoordinate(rectangle.y);
+	int x1 = GetCellCoordinate(rectangle.x + rectangle.width);
+	int y1 = GetCellCoordinate(rectangle.y + rectangle.height);
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			List(CellEntry) bucket = *GetCellBucket(x, y);
+			for (int i = 0; i < ListCount(bucket); ++i)
+			{
+				CellEntry entry = bucket[i];
+				if (entry.cellX != x or entry.cellY != y or entry.object->queryStamp == stamp)
+					continue;
+
+				entry.object->queryStamp = stamp;
+				// Callers do their own exact test, so we only need to filter out objects that are clearly too far away.
+				Rectangle bounds = GetBounds(entry.object);
+				bool overlaps =
+					rectangle.x <= bounds.x + bounds.width and bounds.x <= rectangle.x + rectangle.width and
+					rectangle.y <= bounds.y + bounds.height and bounds.y <= rectangle.y + rectangle.height;
+				if (overlaps)
+					ListAdd(&result, entry.object);
+			}
+		}
+	}
+	return result;
+}
+// Returns every object whose bounds contain the point. The result is allocated from temporary storage.
+List(Object *) QueryObjectsAtPoint(Vector2 point)
+{
+	List(Object *) candidates = QueryObjectsInRectangle({ point.x, point.y, 0, 0 });
 	List(Object *) result = NULL;
 	ListSetAllocator((void **)&result, TempRealloc, TempFree);
-	Object **pointers = ListAllocate(&result, numObjects);
-	for (int i = 0; i < numObjects; ++i)
-		pointers[i] = &objects[i];
-
-	Sort(pointers, numObjects, sizeof pointers[0], [](const void *left, const void *right)
-	{
-		Object *l = *(Object **)left;
-		Object *r = *(Object **)right;
-		float lz = GetFootPositionInScreenSpace(l).y + l->zOffset;
-		float rz = GetFootPositionInScreenSpace(r).y + r->zOffset;
-		if (lz > rz) return -1;
-		if (lz < rz) return +1;
-		return 0;
-	});
+	for (int i = 0; i < ListCount(candidates); ++i)
+		if (CheckCollisionPointRec(point, GetBounds(candidates[i])))
+			ListAdd(&result, candidates[i]);
+	return result;
+}
+// Returns every object whose feet are within the given radius of a point in world space (where distances are measured, see DistanceBetween).
+// The result is allocated from temporary storage.
+List(Object *) QueryObjectsInRadius(Vector2 worldPoint, float radius)
+{
+	// World space is squished vertically compared to the space objects live in.
+	Rectangle rectangle = {
+		worldPoint.x - radius,
+		(worldPoint.y - radius) / Y_SQUISH,
+		2 * radius,
+		2 * radius / Y_SQUISH
+	};
+
+	List(Object *) candidates = QueryObjectsInRectangle(rectangle);
+	List(Object *) result = NULL;
+	ListSetAllocator((void **)&result, TempRealloc, TempFree);
+	for (int i = 0; i < ListCount(candidates); ++i)
+		if (Vector2Distance(GetFootPositionInWorldSpace(candidates[i]), worldPoint) <= radius)
+			ListAdd(&result, candidates[i]);
 	return result;
 }
 Object *FindObjectAtPosition(Vector2 position)
 {
 	Object *result = NULL;
+	float resultZ = -FLT_MAX;
 	int mark = TempMark();
 	{
-		List(Object *) sorted = GetZSortedObjects();
-		for (int i = 0; i < ListCount(sorted); ++i)
+		// The object in front is the one with the highest z.
+		List(Object *) candidates = QueryObjectsAtPoint(position);
+		for (int i = 0; i < ListCount(candidates); ++i)
 		{
-			Object *object = sorted[i];
-			Rectangle outline = GetOutline(object);
-			if (CheckCollisionPointRec(position, outline))
+			Object *object = candidates[i];
+			if (not CheckCollisionPointRec(position, GetOutline(object)))
+				continue;
+
+			float z = object->zKeyIsStale ? ComputeZKey(object) : object->zKey;
+			if (not result or z > resultZ)
 			{
 				result = object;
-				break;
+				resultZ = z;
 			}
 		}
 	}
 	TempReset(mark);
 	return result;
 }
+Vector2 MovePointWithCollisions(Vector2 position, Vector2 velocity)
+{
+	Vector2 newPosition = position + velocity;
+	int mark = TempMark();
+	List(Object *) nearby = QueryObjectsAtPoint(newPosition);
+	for (int i = 0; i < ListCount(nearby); ++i)
+	{
+		Object *object = nearby[i];
+		if (object->collisionMap)
+		{
+			Vector2 topLeft = {
+				object->position.x - 0.5f * object->collisionMap->width,
+				object->position.y - 0.5f * object->collisionMap->height,
+			};
+			Vector2 localPosition = newPosition - topLeft;
+
+			// The mask is 1 bit per pixel, so this is a single bit lookup (anything outside the mask is free).
+			if (CheckCollisionMaskPoint(object->collisionMap, localPosition))
+			{
+				TempReset(mark);
+				return position;
+			}
+		}
+	}
+	TempReset(mark);
+
+	return newPosition;
+}
 
 Vector2 GetMousePositionInWorld(void)
 {
@@ -388,23 +778,44 @@ void UpdateCameraShake()
 
 void Clone(Object *from, Object *to)
 {
+	ObjectInfo *fromInfo = GetInfo(from);
+	ObjectInfo *toInfo = GetInfo(to);
+	int toSlot = toInfo->slot;
 	CopyBytes(to, from, sizeof to[0]);
-	to->script = (Script *)CloneAsset(from->script);
-	to->collisionMap = (Image *)CloneAsset(from->collisionMap);
-	for (int i = 0; i < COUNTOF(from->expressions); ++i)
-		to->expressions[i].portrait = (Texture *)CloneAsset(from->expressions[i].portrait);
+	CopyBytes(toInfo, fromInfo, sizeof toInfo[0]);
+	toInfo->slot = toSlot;
+	to->collisionMap = (CollisionMask *)CloneAsset(from->collisionMap);
+	toInfo->script = (Script *)CloneAsset(fromInfo->script);
+	for (int i = 0; i < COUNTOF(fromInfo->expressions); ++i)
+		toInfo->expressions[i].portrait = (Texture *)CloneAsset(fromInfo->expressions[i].portrait);
 	for (int direction = 0; direction < DIRECTION_ENUM_COUNT; ++direction)
 		to->sprites[direction] = (Sprite *)CloneAsset(from->sprites[direction]);
 }
-void Destroy(Object *object)
+void Destroy(Object *object, ObjectInfo *info)
 {
-	ReleaseAsset(object->script);
 	ReleaseAsset(object->collisionMap);
-	for (int i = 0; i < COUNTOF(object->expressions); ++i)
-		ReleaseAsset(object->expressions[i].portrait);
+	ReleaseAsset(info->script);
+	for (int i = 0; i < COUNTOF(info->expressions); ++i)
+		ReleaseAsset(info->expressions[i].portrait);
 	for (int direction = 0; direction < DIRECTION_ENUM_COUNT; ++direction)
 		ReleaseAsset(object->sprites[direction]);
 	ZeroBytes(object, sizeof object[0]);
+	ZeroBytes(info, sizeof info[0]);
+}
+// Destroys the object at the given index, and shifts all objects after it down by one.
+void RemoveObject(int index)
+{
+	ASSERT(index >= 0 and index < ListCount(objects));
+	FreeObjectSlot(objectInfos[index].slot);
+	Destroy(&objects[index], &objectInfos[index]);
+
+	int numAfter = ListCount(objects) - index - 1;
+	MoveBytes(&objects[index], &objects[index + 1], numAfter * sizeof objects[0]);
+	MoveBytes(&objectInfos[index], &objectInfos[index + 1], numAfter * sizeof objectInfos[0]);
+	ListPop(&objects);
+	ListPop(&objectInfos);
+
+	OnObjectsChanged(index);
 }
 void Update(Object *object)
 {
@@ -418,6 +829,7 @@ void Update(Object *object)
 		{
 			object->animationTimeAccumulator -= animationFrameTime;
 			object->animationFrame = (object->animationFrame + 1) % sprite->numFrames;
+			MarkObjectAsMoved(object); // Frames can have different heights.
 		}
 	}
 
@@ -429,6 +841,7 @@ void Update(Object *object)
 		object->position = object->motionMaster.currentPoint;
 		auto dirVector = object->motionMaster.GetDirection();
 		object->direction = DirectionFromVector(dirVector);
+		MarkObjectAsMoved(object);
 	}
 
 }
@@ -444,19 +857,241 @@ void Render(Object *object)
 	if (stair)
 		position.y += ELEVATION_TO_Y_OFFSET * stair->elevation;
 
+	SpriteFrame *frame = GetCurrentFrame(object);
 	if (sprite == object->sprites[object->direction])
-		DrawTextureCentered(sprite->frames[object->animationFrame], position, WHITE);
+		DrawSpriteFrameCentered(*frame, position, WHITE);
 	else
-		DrawTextureCenteredAndFlippedVertically(sprite->frames[object->animationFrame], position, WHITE);
+		DrawSpriteFrameCenteredAndFlippedVertically(*frame, position, WHITE);
+}
+
+// Scene files start with a header and a table of contents, which lists the tagged chunks that follow it:
+//
+//   "KEKW" version numChunks
+//   numChunks x { tag[4] version offset size }
+//   chunk data...
+//
+// Every chunk can be read on its own, knowing only its offset and size. Loading skips chunks it doesn't know about,
+// and chunks that are newer than we can handle, so new kinds of optional chunks don't break older builds. Objects are
+// a different story: they aren't optional, and their records have no sizes, so a newer objects chunk can't be read
+// at all. Older builds refuse to load such scenes instead of silently opening them without objects.
+STRUCT(SceneChunk)
+{
+	char tag[4];
+	int version;
+	int offset; // From the start of the file.
+	int size;
+};
+
+// Scripts come last, because they load on the main thread while everything else decodes on worker threads.
+ENUM(SceneDependencyKind)
+{
+	DEPENDENCY_COLLISION_MAP,
+	DEPENDENCY_SPRITE,
+	DEPENDENCY_TEXTURE,
+	DEPENDENCY_SCRIPT,
+};
+
+STRUCT(SceneDependency)
+{
+	SceneDependencyKind kind;
+	const char *path;
+};
+
+// An object copied out of the live scene, so that it can be written to a file on a worker thread.
+// The assets it references are kept alive (with CloneAsset) until the save is done, so their paths stay valid.
+STRUCT(SavedObject)
+{
+	Object object;
+	ObjectInfo info;
+	const char *scriptPath;
+	const char *collisionMapPath;
+	const char *spritePaths[DIRECTION_ENUM_COUNT];
+	const char *portraitPaths[MAX_EXPRESSIONS];
+};
+
+// Scenes are saved in the background: SaveScene takes a snapshot of the scene on the main thread, a worker
+// thread serializes it and writes it to disk, and then the main thread cleans up and reports back.
+STRUCT(SceneSave)
+{
+	char path[256];
+	List(SavedObject) objects;
+	Stair stairs[MAX_STAIRS];
+	int numStairs;
+	bool success;
+};
+
+SceneSave *pendingSceneSave; // Only one save can be writing at a time, so that an older save never overwrites a newer one.
+char queuedSceneSavePath[256]; // Another save that was requested while one was already running.
+
+// Reads an objects chunk into new lists. Returns false if the chunk is cut short.
+bool ReadSceneObjects(BinaryStream *stream, int version, List(Object) *newObjects, List(ObjectInfo) *newInfos)
+{
+	ASSERT(version >= 1 and version <= SCENE_OBJECTS_VERSION); // Add conversions from older versions here.
+
+	// Acquire all the new assets before releasing the old ones, so assets that both scenes use don't get reloaded.
+	int numObjects = ReadInt(stream);
+	for (int i = 0; i < numObjects and stream->cursor < stream->size; ++i)
+	{
+		Object *object = ListAllocateItem(newObjects);
+		ObjectInfo *info = ListAllocateItem(newInfos);
+		ZeroBytes(object, sizeof object[0]);
+		ZeroBytes(info, sizeof info[0]);
+
+		const char *name = ReadString(stream);
+		CopyString(info->name, name, sizeof info->name);
+		
+		object->position.x = ReadFloat(stream);
+		object->position.y = ReadFloat(stream);
+		object->zOffset = ReadFloat(stream);
+		object->animationFps = ReadFloat(stream);
+		object->talkRange = ReadFloat(stream);
+		object->autoTalkInRange = ReadBool(stream);
+		object->direction = (Direction)ReadInt(stream);
+		info->script = AcquireScript(ReadString(stream), &roboto, &robotoBold, &robotoItalic, &robotoBoldItalic);
+		object->collisionMap = AcquireCollisionMap(ReadString(stream));
+		for (int dir = 0; dir < DIRECTION_ENUM_COUNT; ++dir)
+			object->sprites[dir] = AcquireSprite(ReadString(stream));
+		for (int j = 0; j < COUNTOF(info->expressions); ++j)
+		{
+			Expression *expression = &info->expressions[j];
+			const char *expressionName = ReadString(stream);
+			CopyString(expression->name, expressionName, sizeof expression->name);
+			expression->portrait = AcquireTexture(ReadString(stream));
+		}
+	}
+
+	return ListCount(*newObjects) == numObjects;
+}
+void WriteSceneObjects(BinaryStream *stream, const SceneSave *save)
+{
+	WriteInt(stream, ListCount(save->objects));
+	for (int i = 0; i < ListCount(save->objects); ++i)
+	{
+		const SavedObject *saved = &save->objects[i];
+		const Object *object = &saved->object;
+		const ObjectInfo *info = &saved->info;
+		
+		WriteString(stream, info->name);
+		WriteFloat(stream, object->position.x);
+		WriteFloat(stream, object->position.y);
+		WriteFloat(stream, object->zOffset);
+		WriteFloat(stream, object->animationFps);
+		WriteFloat(stream, object->talkRange);
+		WriteBool(stream, object->autoTalkInRange);
+		WriteInt(stream, object->direction);
+		WriteString(stream, saved->scriptPath);
+		WriteString(stream, saved->collisionMapPath);
+		for (int dir = 0; dir < DIRECTION_ENUM_COUNT; ++dir)
+			WriteString(stream, saved->spritePaths[dir]);
+		for (int j = 0; j < COUNTOF(info->expressions); ++j)
+		{
+			WriteString(stream, info->expressions[j].name);
+			WriteString(stream, saved->portraitPaths[j]);
+		}
+	}
 }
+// Reads a stairs chunk into newStairs, which has room for as many stairs as the stairs array. Returns how many there are.
+int ReadSceneStairs(BinaryStream *stream, int version, Stair *newStairs)
+{
+	ASSERT(version >= 1 and version <= SCENE_STAIRS_VERSION); // Add conversions from older versions here.
+
+	int count = ClampInt(ReadInt(stream), 0, COUNTOF(stairs));
+	ReadBytesInto(stream, newStairs, count * sizeof newStairs[0]);
+	return count;
+}
+void WriteSceneStairs(BinaryStream *stream, const SceneSave *save)
+{
+	WriteInt(stream, save->numStairs);
+	WriteBytes(stream, save->stairs, save->numStairs * sizeof save->stairs[0]);
+}
+int CompareSceneDependencies(const void *left, const void *right)
+{
+	const SceneDependency *l = (const SceneDependency *)left;
+	const SceneDependency *r = (const SceneDependency *)right;
+	if (l->kind != r->kind)
+		return l->kind < r->kind ? -1 : +1;
+	// Asset paths point into the asset itself, so the same path is always the same pointer.
+	if (l->path != r->path)
+		return (uintptr_t)l->path < (uintptr_t)r->path ? -1 : +1;
+	return 0;
+}
+// Acquires every asset listed in a dependencies chunk, so they all start loading before we read the objects that use them.
+void ReadSceneDependencies(BinaryStream *stream, int version, List(void *) *preloadedAssets)
+{
+	ASSERT(version >= 1 and version <= SCENE_DEPENDENCIES_VERSION); // Add conversions from older versions here.
 
+	int count = ReadInt(stream);
+	for (int i = 0; i < count and stream->cursor < stream->size; ++i)
+	{
+		SceneDependencyKind kind = (SceneDependencyKind)ReadInt(stream);
+		const char *path = ReadString(stream);
+
+		void *asset = NULL;
+		switch (kind)
+		{
+			case DEPENDENCY_COLLISION_MAP: asset = AcquireCollisionMap(path); break;
+			case DEPENDENCY_SPRITE:        asset = AcquireSprite(path);       break;
+			case DEPENDENCY_TEXTURE:       asset = AcquireTexture(path);      break;
+			case DEPENDENCY_SCRIPT:        asset = AcquireScript(path, &roboto, &robotoBold, &robotoItalic, &robotoBoldItalic); break;
+		}
+		if (asset)
+			ListAdd(preloadedAssets, asset);
+	}
+}
+// Every asset the scene references, each listed once.
+void WriteSceneDependencies(BinaryStream *stream, const SceneSave *save)
+{
+	List(SceneDependency) dependencies = NULL;
+	for (int i = 0; i < ListCount(save->objects); ++i)
+	{
+		const SavedObject *saved = &save->objects[i];
+		SceneDependency dependency;
+		dependency.kind = DEPENDENCY_COLLISION_MAP;
+		dependency.path = saved->collisionMapPath;
+		ListAdd(&dependencies, dependency);
+		dependency.kind = DEPENDENCY_SCRIPT;
+		dependency.path = saved->scriptPath;
+		ListAdd(&dependencies, dependency);
+		for (int dir = 0; dir < DIRECTION_ENUM_COUNT; ++dir)
+		{
+			dependency.kind = DEPENDENCY_SPRITE;
+			dependency.path = saved->spritePaths[dir];
+			ListAdd(&dependencies, dependency);
+		}
+		for (int j = 0; j < COUNTOF(saved->portraitPaths); ++j)
+		{
+			dependency.kind = DEPENDENCY_TEXTURE;
+			dependency.path = saved->portraitPaths[j];
+			ListAdd(&dependencies, dependency);
+		}
+	}
+
+	Sort(dependencies, ListCount(dependencies), sizeof dependencies[0], CompareSceneDependencies);
+	int numUnique = 0;
+	for (int i = 0; i < ListCount(dependencies); ++i)
+	{
+		if (not dependencies[i].path)
+			continue;
+		if (numUnique > 0 and CompareSceneDependencies(&dependencies[i], &dependencies[numUnique - 1]) == 0)
+			continue;
+		dependencies[numUnique++] = dependencies[i];
+	}
+
+	WriteInt(stream, numUnique);
+	for (int i = 0; i < numUnique; ++i)
+	{
+		WriteInt(stream, dependencies[i].kind);
+		WriteString(stream, dependencies[i].path);
+	}
+	ListDestroy((void **)&dependencies);
+}
 void LoadScene(const char *path)
 {
-	unsigned dataSize;
-	unsigned char *data = LoadFileData(path, &dataSize);
+	int dataSize;
+	unsigned char *data = LoadAssetData(path, &dataSize);
 	if (not data)
 	{
-		if (not FileExists(path))
+		if (not AssetExists(path))
 			LogError("Couldn't load scene from '%s' because that file doesn't exist.", path);
 		else
 			LogError("Couldn't load scene from '%s' because we failed to load the file contents.", path);
@@ -465,11 +1100,11 @@ void LoadScene(const char *path)
 
 	BinaryStream stream = { 0 };
 	stream.buffer = data;
-	stream.size = (int)dataSize;
+	stream.size = dataSize;
 	stream.cursor = 0;
 
 	const void *magic = ReadBytes(&stream, 4);
-	if (not BytesEqual(magic, SCENE_MAGIC, 4))
+	if (not magic or not BytesEqual(magic, SCENE_MAGIC, 4))
 	{
 		UnloadFileData(data);
 		LogError("Couldn't load scene from '%s' because it isn't a scene file.", path);
@@ -477,105 +1112,260 @@ void LoadScene(const char *path)
 	}
 
 	int version = ReadInt(&stream);
-	if (version != SCENE_VERSION)
+	if (version != SCENE_VERSION and version != SCENE_LEGACY_VERSION)
 	{
 		UnloadFileData(data);
-		LogError("Couldn't load scene from '%s' because it's version is %d, but we only handle version %d.", path, version, SCENE_VERSION);
+		LogError("Couldn't load scene from '%s' because it's version is %d, but we only handle versions %d and %d.", path, version, SCENE_LEGACY_VERSION, SCENE_VERSION);
 		return;
 	}
 
-	Object newObjects[COUNTOF(objects)];
-	ZeroBytes(newObjects, sizeof newObjects);
-
-	int newNumObjects = ReadInt(&stream);
-	for (int i = 0; i < newNumObjects; ++i)
+	List(Object) newObjects = NULL;
+	List(ObjectInfo) newInfos = NULL;
+	List(void *) preloadedAssets = NULL;
+	Stair newStairs[COUNTOF(stairs)];
+	int newNumStairs = 0;
+	bool foundObjects = false;
+	int newerObjectsVersion = 0;
+	bool success = true;
+	if (version == SCENE_LEGACY_VERSION)
 	{
-		Object *object = &newObjects[i];
-		const char *name = ReadString(&stream);
-		CopyString(object->name, name, sizeof object->name);
-		
-		object->position.x = ReadFloat(&stream);
-		object->position.y = ReadFloat(&stream);
-		object->zOffset = ReadFloat(&stream);
-		object->animationFps = ReadFloat(&stream);
-		object->talkRange = ReadFloat(&stream);
-		object->autoTalkInRange = ReadBool(&stream);
-		object->direction = (Direction)ReadInt(&stream);
-		object->script = AcquireScript(ReadString(&stream), roboto, robotoBold, robotoItalic, robotoBoldItalic);
-		object->collisionMap = AcquireCollisionMap(ReadString(&stream));
-		for (int dir = 0; dir < DIRECTION_ENUM_COUNT; ++dir)
-			object->sprites[dir] = AcquireSprite(ReadString(&stream));
-		for (int j = 0; j < COUNTOF(object->expressions); ++j)
+		// Legacy scenes are just the contents of the first versions of the objects and stairs chunks, one after the other.
+		foundObjects = true;
+		success = ReadSceneObjects(&stream, 1, &newObjects, &newInfos);
+		if (success)
+			newNumStairs = ReadSceneStairs(&stream, 1, newStairs);
+	}
+	else
+	{
+		// Check the count before multiplying, a corrupted count could overflow and make the table look tiny.
+		int numChunks = ReadInt(&stream);
+		const SceneChunk *chunks = NULL;
+		if (numChunks >= 0 and numChunks <= (stream.size - stream.cursor) / (int)sizeof(SceneChunk))
+			chunks = (const SceneChunk *)ReadBytes(&stream, numChunks * (int)sizeof(SceneChunk));
+		if (not chunks)
 		{
-			Expression *expression = &object->expressions[j];
-			const char *expressionName = ReadString(&stream);
-			CopyString(expression->name, expressionName, sizeof expression->name);
-			expression->portrait = AcquireTexture(ReadString(&stream));
+			UnloadFileData(data);
+			LogError("Couldn't load scene from '%s' because its table of contents is cut short.", path);
+			return;
 		}
-	}
 
-	for (int i = 0; i < numObjects; ++i)
-		Destroy(&objects[i]);
+		// Start loading everything the scene needs before we read any objects, so all the assets decode in parallel
+		// on the worker threads instead of trickling in one by one, in whatever order the objects happen to be in.
+		for (int i = 0; i < numChunks; ++i)
+		{
+			SceneChunk chunk;
+			CopyBytes(&chunk, &chunks[i], sizeof chunk);
+			if (BytesEqual(chunk.tag, SCENE_CHUNK_DEPENDENCIES, 4) and chunk.version >= 1 and chunk.version <= SCENE_DEPENDENCIES_VERSION and
+				chunk.offset >= 0 and chunk.size >= 0 and chunk.offset <= stream.size - chunk.size)
+			{
+				BinaryStream chunkStream = { 0 };
+				chunkStream.buffer = data + chunk.offset;
+				chunkStream.size = chunk.size;
+				ReadSceneDependencies(&chunkStream, chunk.version, &preloadedAssets);
+				break;
+			}
+		}
 
-	numObjects = newNumObjects;
-	CopyBytes(objects, newObjects, newNumObjects * sizeof objects[0]);
-	numStairs = ReadInt(&stream);
-	ReadBytesInto(&stream, stairs, numStairs * sizeof stairs[0]);
+		for (int i = 0; i < numChunks and success; ++i)
+		{
+			SceneChunk chunk;
+			CopyBytes(&chunk, &chunks[i], sizeof chunk);
+			if (chunk.offset < 0 or chunk.size < 0 or chunk.offset > stream.size - chunk.size)
+			{
+				LogError("Couldn't load scene from '%s' because chunk '%.4s' is outside of the file.", path, chunk.tag);
+				success = false;
+				break;
+			}
+
+			// Each chunk gets its own stream, so a chunk can never read into the next one.
+			BinaryStream chunkStream = { 0 };
+			chunkStream.buffer = data + chunk.offset;
+			chunkStream.size = chunk.size;
 
+			if (BytesEqual(chunk.tag, SCENE_CHUNK_OBJECTS, 4) and chunk.version >= 1 and chunk.version <= SCENE_OBJECTS_VERSION and not foundObjects)
+			{
+				foundObjects = true;
+				success = ReadSceneObjects(&chunkStream, chunk.version, &newObjects, &newInfos);
+			}
+			else if (BytesEqual(chunk.tag, SCENE_CHUNK_STAIRS, 4) and chunk.version >= 1 and chunk.version <= SCENE_STAIRS_VERSION)
+				newNumStairs = ReadSceneStairs(&chunkStream, chunk.version, newStairs);
+			else if (BytesEqual(chunk.tag, SCENE_CHUNK_DEPENDENCIES, 4) and chunk.version >= 1 and chunk.version <= SCENE_DEPENDENCIES_VERSION)
+				continue; // Already handled above.
+			else if (BytesEqual(chunk.tag, SCENE_CHUNK_OBJECTS, 4) and chunk.version > SCENE_OBJECTS_VERSION)
+				newerObjectsVersion = chunk.version;
+			else
+				LogWarning("Skipping chunk '%.4s' version %d in scene '%s', we don't know how to read it.", chunk.tag, chunk.version, path);
+		}
+	}
 	UnloadFileData(data);
+
+	// The objects hold their own references now.
+	for (int i = 0; i < ListCount(preloadedAssets); ++i)
+		ReleaseAsset(preloadedAssets[i]);
+	ListDestroy((void **)&preloadedAssets);
+
+	if (not foundObjects or not success)
+	{
+		if (success and newerObjectsVersion)
+			LogError("Couldn't load scene from '%s' because it was saved by a newer build (objects version %d, but we only handle up to %d).", path, newerObjectsVersion, SCENE_OBJECTS_VERSION);
+		else if (success)
+			LogError("Couldn't load scene from '%s' because it has no objects.", path);
+		else
+			LogError("Couldn't load scene from '%s' because it's corrupted.", path);
+
+		for (int i = 0; i < ListCount(newObjects); ++i)
+			Destroy(&newObjects[i], &newInfos[i]);
+		ListDestroy((void **)&newObjects);
+		ListDestroy((void **)&newInfos);
+		return;
+	}
+
+	for (int i = 0; i < ListCount(objects); ++i)
+	{
+		FreeObjectSlot(objectInfos[i].slot);
+		Destroy(&objects[i], &objectInfos[i]);
+	}
+	ListDestroy((void **)&objects);
+	ListDestroy((void **)&objectInfos);
+	objects = newObjects;
+	objectInfos = newInfos;
+	for (int i = 0; i < ListCount(objects); ++i)
+		objectInfos[i].slot = AllocateObjectSlot(i);
+	if (ListCount(objects) == 0)
+		InsertObject(0); // There always has to be a player.
+	OnObjectsChanged(0);
+	numStairs = newNumStairs;
+	CopyBytes(stairs, newStairs, newNumStairs * sizeof stairs[0]);
+
+	// This is the only place we block, everything was already loading in parallel.
+	WaitForAllJobs();
+
 	LogInfo("Successfully loaded scene '%s'.", path);
 	CopyString(options.scene, path, sizeof options.scene);
 	
 	if (GetCurrentGameState() == GAMESTATE_TALKING)
 		PopGameState();
 	
-	CenterCameraOn(&objects[0]);
+	CenterCameraOn(player);
 }
-void SaveScene(const char *path)
+void SaveScene(const char *path);
+
+// Runs on a worker thread.
+void WriteSceneSave(void *data)
 {
-	int maxBytes = 32 * 1024; // 32kB should be plenty!
-	void *data = TempAlloc(maxBytes);
+	SceneSave *save = (SceneSave *)data;
 
-	BinaryStream stream = { 0 };
-	stream.buffer = data;
-	stream.size = maxBytes;
+	STRUCT(ChunkWriter) { const char *tag; int version; void (*write)(BinaryStream *stream, const SceneSave *save); };
+	static const ChunkWriter writers[] = {
+		{ SCENE_CHUNK_DEPENDENCIES, SCENE_DEPENDENCIES_VERSION, WriteSceneDependencies },
+		{ SCENE_CHUNK_OBJECTS,      SCENE_OBJECTS_VERSION,      WriteSceneObjects      },
+		{ SCENE_CHUNK_STAIRS,       SCENE_STAIRS_VERSION,       WriteSceneStairs       },
+	};
 
+	BinaryStream stream = CreateGrowableBinaryStream(32 * 1024);
 	WriteBytes(&stream, SCENE_MAGIC, 4);
 	WriteInt(&stream, SCENE_VERSION);
-	WriteInt(&stream, numObjects);
-	for (int i = 0; i < numObjects; ++i)
+	WriteInt(&stream, COUNTOF(writers));
+
+	// Leave room for the table of contents, we fill it in once we know where each chunk ended up.
+	SceneChunk chunks[COUNTOF(writers)];
+	ZeroBytes(chunks, sizeof chunks);
+	int tableOfContents = stream.cursor;
+	WriteBytes(&stream, chunks, sizeof chunks);
+
+	for (int i = 0; i < COUNTOF(writers); ++i)
 	{
-		Object *object = &objects[i];
-		
-		WriteString(&stream, object->name);
-		WriteFloat(&stream, object->position.x);
-		WriteFloat(&stream, object->position.y);
-		WriteFloat(&stream, object->zOffset);
-		WriteFloat(&stream, object->animationFps);
-		WriteFloat(&stream, object->talkRange);
-		WriteBool(&stream, object->autoTalkInRange);
-		WriteInt(&stream, object->direction);
-		WriteString(&stream, GetAssetPath(object->script));
-		WriteString(&stream, GetAssetPath(object->collisionMap));
-		for (int dir = 0; dir < DIRECTION_ENUM_COUNT; ++dir)
-			WriteString(&stream, GetAssetPath(object->sprites[dir]));
-		for (int j = 0; j < COUNTOF(object->expressions); ++j)
-		{
-			Expression *expression = &object->expressions[j];
-			WriteString(&stream, expression->name);
-			WriteString(&stream, GetAssetPath(expression->portrait));
-		}
+		CopyBytes(chunks[i].tag, writers[i].tag, 4);
+		chunks[i].version = writers[i].version;
+		chunks[i].offset = stream.cursor;
+		writers[i].write(&stream, save);
+		chunks[i].size = stream.cursor - chunks[i].offset;
 	}
-	WriteInt(&stream, numStairs);
-	WriteBytes(&stream, stairs, numStairs * sizeof stairs[0]);
 
-	if (SaveFileData(path, stream.buffer, (unsigned)stream.cursor))
+	// A write that didn't fit would leave the chunks shorter than the table of contents says, so don't save anything then.
+	save->success = not stream.hasError;
+	if (save->success)
+	{
+		CopyBytes((char *)stream.buffer + tableOfContents, chunks, sizeof chunks);
+		save->success = SaveFileDataAtomically(save->path, stream.buffer, stream.cursor);
+	}
+	DestroyGrowableBinaryStream(&stream);
+}
+// Runs on the main thread once WriteSceneSave is done.
+void FinishSceneSave(void *data)
+{
+	SceneSave *save = (SceneSave *)data;
+	if (save->success)
 	{
-		LogInfo("Successfully saved current scene to '%s'.", path);
-		CopyString(options.scene, path, sizeof options.scene);
+		LogInfo("Successfully saved current scene to '%s'.", save->path);
+		CopyString(options.scene, save->path, sizeof options.scene);
 	}
 	else
-		LogInfo("Couldn't save current scene to '%s'.", path);
+		LogError("Couldn't save current scene to '%s'.", save->path);
+
+	for (int i = 0; i < ListCount(save->objects); ++i)
+	{
+		SavedObject *saved = &save->objects[i];
+		ReleaseAsset(saved->object.collisionMap);
+		ReleaseAsset(saved->info.script);
+		for (int j = 0; j < COUNTOF(saved->info.expressions); ++j)
+			ReleaseAsset(saved->info.expressions[j].portrait);
+		for (int dir = 0; dir < DIRECTION_ENUM_COUNT; ++dir)
+			ReleaseAsset(saved->object.sprites[dir]);
+	}
+	ListDestroy((void **)&save->objects);
+	MemFree(save);
+	pendingSceneSave = NULL;
+
+	if (queuedSceneSavePath[0])
+	{
+		char queuedPath[sizeof queuedSceneSavePath];
+		CopyString(queuedPath, queuedSceneSavePath, sizeof queuedPath);
+		queuedSceneSavePath[0] = 0;
+		SaveScene(queuedPath);
+	}
+}
+void SaveScene(const char *path)
+{
+	if (pendingSceneSave)
+	{
+		// We'll take the snapshot once the running save is done, so it has all the changes made until then.
+		CopyString(queuedSceneSavePath, path, sizeof queuedSceneSavePath);
+		return;
+	}
+
+	// Snapshot the scene. This only copies memory, the slow part happens on a worker thread.
+	SceneSave *save = (SceneSave *)MemAlloc(sizeof save[0]);
+	CopyString(save->path, path, sizeof save->path);
+	save->numStairs = numStairs;
+	CopyBytes(save->stairs, stairs, numStairs * sizeof stairs[0]);
+	for (int i = 0; i < ListCount(objects); ++i)
+	{
+		SavedObject *saved = ListAllocateItem(&save->objects);
+		ZeroBytes(saved, sizeof saved[0]);
+		CopyBytes(&saved->object, &objects[i], sizeof saved->object);
+		CopyBytes(&saved->info, &objectInfos[i], sizeof saved->info);
+
+		// Worker threads can't look up asset paths, so we do it here.
+		saved->object.collisionMap = (CollisionMask *)CloneAsset(saved->object.collisionMap);
+		saved->info.script = (Script *)CloneAsset(saved->info.script);
+		saved->collisionMapPath = GetAssetPath(saved->object.collisionMap);
+		saved->scriptPath = GetAssetPath(saved->info.script);
+		for (int dir = 0; dir < DIRECTION_ENUM_COUNT; ++dir)
+		{
+			saved->object.sprites[dir] = (Sprite *)CloneAsset(saved->object.sprites[dir]);
+			saved->spritePaths[dir] = GetAssetPath(saved->object.sprites[dir]);
+		}
+		for (int j = 0; j < COUNTOF(saved->info.expressions); ++j)
+		{
+			Expression *expression = &saved->info.expressions[j];
+			expression->portrait = (Texture *)CloneAsset(expression->portrait);
+			saved->portraitPaths[j] = GetAssetPath(expression->portrait);
+		}
+	}
+
+	pendingSceneSave = save;
+	SubmitJob(WriteSceneSave, FinishSceneSave, save);
 }
 
 Vector2 SnapToGrid(Vector2 position)
@@ -630,6 +1420,7 @@ bool HandlePlayerTeleportCommand(List(const char *) args)
 
 	player->position.x = x;
 	player->position.y = y;
+	MarkObjectAsMoved(player);
 	return true;
 }
 bool HandleToggleDevModeCommand(List(const char *) args)
@@ -651,6 +1442,23 @@ bool HandleToggleDevModeCommand(List(const char *) args)
 	LogInfo("Dev mode turned %s.", options.devMode ? "on" : "off");
 	return true;
 }
+bool HandleToggleProfilerCommand(List(const char *) args)
+{
+	// profiler [bool]
+	if (ListCount(args) == 0)
+	{
+		SetProfilerGuiOpen(not IsProfilerGuiOpen());
+		return true;
+	}
+
+	bool success;
+	bool arg = ParseCommandBoolArg(args[0], &success);
+	if (!success)
+		return false;
+
+	SetProfilerGuiOpen(arg);
+	return true;
+}
 bool HandleCameraShakeCommand(List(const char *) args)
 {
 	// shake [trauma] [falloff]
@@ -761,6 +1569,53 @@ bool HandleLoadCommand(List(const char *) args)
 	LoadScene(path);
 	return true;
 }
+bool HandlePackCommand(List(const char *) args)
+{
+	// pack [filename:string]
+	if (ListCount(args) > 1)
+		return false;
+
+	const char *path = ASSET_PACK_PATH;
+	if (ListCount(args) == 1)
+		path = args[0];
+
+	// We might be about to overwrite the mounted pack, so make sure nothing is reading from it anymore.
+	WaitForAllJobs();
+	UnmountAssetPack();
+	bool success = WriteAssetPack(".", path);
+	if (not options.devMode)
+		MountAssetPack(ASSET_PACK_PATH);
+	return success;
+}
+bool HandleAssetCacheCommand(List(const char *) args)
+{
+	// assetcache [megabytes:float]
+	if (ListCount(args) > 1)
+		return false;
+
+	if (ListCount(args) == 1)
+	{
+		bool success;
+		float megabytes = ParseCommandFloatArg(args[0], &success);
+		if (not success or megabytes < 0)
+			return false;
+		SetAssetCacheBudget((int)(megabytes * 1024 * 1024));
+	}
+
+	LogInfo("Asset cache: %d assets, %.1f MB of %.1f MB.", GetNumCachedAssets(),
+		GetAssetCacheBytes() / (1024.0 * 1024.0), GetAssetCacheBudget() / (1024.0 * 1024.0));
+	return true;
+}
+bool HandleTraceCommand(List(const char *) args)
+{
+	// trace start
+	// trace stop [filename:string]
+	if (ListCount(args) == 1 and StringsEqual(args[0], "start"))
+		return StartTrace();
+	if (ListCount(args) >= 1 and ListCount(args) <= 2 and StringsEqual(args[0], "stop"))
+		return StopTrace(ListCount(args) == 2 ? args[1] : "trace.json");
+	return false;
+}
 
 //
 // Playing
@@ -779,21 +1634,30 @@ void Playing_Update()
 		return;
 	}
 
-	for (int i = 1; i < numObjects; ++i)
+	// Only objects within the largest talk range can possibly be talked to, so we let the spatial grid narrow them down.
+	Object *talkTarget = NULL;
+	int mark = TempMark();
 	{
-		Object *object = &objects[i];
-		if (not object->script)
-			continue;
-		if (DistanceBetween(player, object) < object->talkRange)
+		List(Object *) nearby = QueryObjectsInRadius(GetFootPositionInWorldSpace(player), spatialGrid.maxTalkRange);
+		for (int i = 0; i < ListCount(nearby); ++i)
 		{
-			if (input.interact.wasPressed or object->autoTalkInRange)
-			{
-
-				PushGameState(GAMESTATE_TALKING, object);
-				return;
-			}
+			Object *object = nearby[i];
+			if (object == player or not GetInfo(object)->script)
+				continue;
+			if (talkTarget and talkTarget < object)
+				continue; // Pick the same object that a linear scan over the objects array would.
+			if (DistanceBetween(player, object) < object->talkRange)
+				if (input.interact.wasPressed or object->autoTalkInRange)
+					talkTarget = object;
 		}
 	}
+	TempReset(mark);
+	if (talkTarget)
+	{
+		ObjectHandle handle = GetObjectHandle(talkTarget);
+		PushGameState(GAMESTATE_TALKING, &handle);
+		return;
+	}
 
 	float moveSpeed = 5;
 	if (input.sprint.isDown)
@@ -816,17 +1680,18 @@ void Playing_Update()
 		playerVelocity = deltaPos;
 
 		// In the isometric perspective, the y direction is squished down a little bit.
-		Texture *texture = GetCurrentTexture(player);
-		if (texture)
+		SpriteFrame *frame = GetCurrentFrame(player);
+		if (frame)
 		{
 			Vector2 feetPos = player->position;
-			feetPos.y += 0.5f * GetCurrentTexture(player)->height;
+			feetPos.y += 0.5f * frame->source.height;
 			Vector2 newFeetPos = MovePointWithCollisions(feetPos, deltaPos);
 			player->position = player->position + (newFeetPos - feetPos);
 		}
+		MarkObjectAsMoved(player); // Even if we didn't move, the direction and so the sprite might have changed.
 	}
 
-	for (int i = 0; i < numObjects; i++)
+	for (int i = 0; i < ListCount(objects); i++)
 		Update(&objects[i]);
 
 	Vector2 targetCameraOffset = options.cameraOffset * playerVelocity;
@@ -874,13 +1739,13 @@ REGISTER_GAME_STATE(GAMESTATE_PLAYING, NULL, NULL, Playing_Update, Playing_Rende
 // Talking
 //
 
-Object *talkingObject;
+ObjectHandle talkingObject;
 int paragraphIndex;
 
 void Talking_Init(void *param)
 {
-	talkingObject = (Object *)param;
-	talkingObject->script->commandIndex = 0;
+	talkingObject = *(ObjectHandle *)param;
+	GetInfo(ResolveObjectHandle(talkingObject))->script->commandIndex = 0;
 	paragraphIndex = 0;
 }
 void Talking_Update()
@@ -891,9 +1756,16 @@ void Talking_Update()
 		return;
 	}
 
-	Script *script = talkingObject->script;
+	Object *object = ResolveObjectHandle(talkingObject);
+	if (not object)
+	{
+		PopGameState(); // The object we were talking to is gone.
+		return;
+	}
+
+	Script *script = GetInfo(object)->script;
 	int prevParagraphIndex = paragraphIndex;
-	int numParagraphs = ListCount(script->paragraphs);
+	int numParagraphs = script->numParagraphs;
 	if (paragraphIndex >= numParagraphs)
 		paragraphIndex = numParagraphs - 1;
 
@@ -924,7 +1796,7 @@ void Talking_Update()
 		else
 		{
 			++paragraphIndex;
-			if (paragraphIndex >= ListCount(script->paragraphs))
+			if (paragraphIndex >= script->numParagraphs)
 			{
 				PopGameState();
 				return;
@@ -936,17 +1808,24 @@ void Talking_Update()
 	if (paragraphIndex != prevParagraphIndex)
 		script->commandIndex = 0;
 
+	// Commands run here rather than when the text is drawn, so they also run when we're not rendering (HEADLESS builds).
+	ExecuteScriptCommands(script, paragraphIndex, 20 * (float)GetTimeInCurrentGameState());
+
 	UpdateCameraShake();
 }
 void Talking_Render()
 {
 	CallPreviousGameStateRender();
 
-	Script *script = talkingObject->script;
+	Object *object = ResolveObjectHandle(talkingObject);
+	if (not object)
+		return;
+
+	Script *script = GetInfo(object)->script;
 	Paragraph paragraph = script->paragraphs[paragraphIndex];
 	const char *speaker = paragraph.speaker;
 	if (not paragraph.speaker)
-		speaker = talkingObject->name;
+		speaker = GetInfo(object)->name;
 
 	float time = 20 * (float)GetTimeInCurrentGameState();
 	const char *expression = GetScriptExpression(*script, paragraphIndex, time);
@@ -964,7 +1843,7 @@ void Talking_Render()
 		if (speakerObject)
 		{
 			Texture *portrait = GetCharacterPortrait(speakerObject, expression);
-			if (portrait)
+			if (portrait and IsAssetReady(portrait))
 			{
 				Rectangle portraitBox = textbox;
 				portraitBox.x = 30;
@@ -1107,15 +1986,19 @@ void Editor_Render()
 
 	BeginMode2D(camera);
 	{
-		static Object *pressedObject;
-		static Object *selectedObject;
-		static Object *draggedObject;
+		static ObjectHandle pressedHandle;
+		static ObjectHandle selectedHandle;
+		static ObjectHandle draggedHandle;
 		static Vector2 draggedObjectFreeformPosition;
 
 		bool isInObjectsTab = false;
 		bool isInStairsTab = false;
 		if (ImGui::Begin("Editor"))
 		{
+			ImGui_ImplRaylib_RenderStats imguiStats = ImGui_ImplRaylib_GetRenderStats();
+			ImGui::Text("ImGui: %d draw calls, %d vertices", imguiStats.DrawCalls, imguiStats.Vertices);
+			ImGui::Text("Sprite atlas: %d pages", GetNumAtlasPages());
+			ImGui::Text("Glyph cache: %d glyphs, %d pages", GetNumCachedGlyphs(), GetNumGlyphCachePages());
 			ImGui::BeginTabBar("Tabs");
 			{
 				if (ImGui::BeginTabItem("Console"))
@@ -1127,7 +2010,7 @@ void Editor_Render()
 				{
 					isInObjectsTab = true;
 					ImGui::BeginTable("Columns", 2, ImGuiTableFlags_BordersInner | ImGuiTableFlags_Resizable);
-					ImGui::TableSetupColumn(TempFormat("Objects %d/%d", numObjects, (int)COUNTOF(objects)));
+					ImGui::TableSetupColumn(TempFormat("Objects (%d)", ListCount(objects)));
 					ImGui::TableSetupColumn("Properties");
 					ImGui::TableHeadersRow();
 					ImGui::TableNextRow();
@@ -1137,13 +2020,13 @@ void Editor_Render()
 						{
 							ImGui::BeginTable("Controls", 3, ImGuiTableFlags_SizingStretchProp);
 							{
-								for (int i = 0; i < numObjects; ++i)
+								for (int i = 0; i < ListCount(objects); ++i)
 								{
 									ImGui::TableNextRow();
 									ImGui::PushID(i);
 									{
 										Object *object = &objects[i];
-										bool selected = selectedObject == &objects[i];
+										bool selected = ResolveObjectHandle(selectedHandle) == object;
 
 										ImGui::TableNextColumn();
 										if (i == 0)
@@ -1153,18 +2036,16 @@ void Editor_Render()
 										ImGui::PushStyleColor(ImGuiCol_ButtonActive, IM_COL32(150, 20, 20, 255));
 										if (ImGui::Button("x") or (i > 0 and selected and IsKeyPressed(KEY_DELETE)))
 										{
-											if (i == numObjects - 1)
+											RemoveObject(i);
+											if (selected)
+												selectedHandle = GetObjectHandle(&objects[i < ListCount(objects) ? i : i - 1]);
+											selected = false;
+											if (i == ListCount(objects))
 											{
-												if (numObjects <= 1)
-													selectedObject = NULL;
-												else
-													selectedObject = &objects[i - 1];
+												ImGui::PopStyleColor(3);
+												ImGui::PopID();
+												break;
 											}
-
-											Destroy(&objects[i]);
-											CopyBytes(&objects[i], &objects[i + 1], (numObjects - i - 1) * sizeof objects[i]);
-											--numObjects;
-											selected = false;
 											object = &objects[i];
 										}
 										ImGui::PopStyleColor(3);
@@ -1172,24 +2053,20 @@ void Editor_Render()
 											ImGui::EndDisabled();
 
 										ImGui::TableNextColumn();
-										if (ImGui::Selectable(object->name, &selected))
-											selectedObject = object;
+										if (ImGui::Selectable(GetInfo(object)->name, &selected))
+											selectedHandle = GetObjectHandle(object);
 
 										ImGui::TableNextColumn();
 										if (ImGui::Button("Clone"))
 										{
-											if (numObjects < COUNTOF(objects))
-											{
-												char cloneName[sizeof object->name];
-												CopyString(cloneName, object->name, sizeof cloneName);
-												for (int suffix = 2; suffix < 100 and FindObjectByName(cloneName); ++suffix)
-													FormatString(cloneName, sizeof cloneName, "%s%d", object->name, suffix);
-
-												CopyBytes(&objects[i + 2], &objects[i + 1], (numObjects - i - 1) * sizeof objects[i]);
-												++numObjects;
-												Clone(&objects[i], &objects[i + 1]);
-												CopyString(objects[i + 1].name, cloneName, sizeof objects[i + 1].name);
-											}
+											char cloneName[sizeof objectInfos[0].name];
+											CopyString(cloneName, GetInfo(object)->name, sizeof cloneName);
+											for (int suffix = 2; suffix < 100 and FindObjectByName(cloneName); ++suffix)
+												FormatString(cloneName, sizeof cloneName, "%s%d", GetInfo(object)->name, suffix);
+
+											InsertObject(i + 1);
+											Clone(&objects[i], &objects[i + 1]);
+											CopyString(objectInfos[i + 1].name, cloneName, sizeof objectInfos[i + 1].name);
 										}
 									}
 									ImGui::PopID();
@@ -1198,12 +2075,11 @@ void Editor_Render()
 								ImGui::TableNextRow();
 								ImGui::TableNextColumn();
 								ImGui::TableNextColumn();
-								if (ImGui::Button("+", ImVec2(ImGui::GetContentRegionAvail().x, 0)) and numObjects < COUNTOF(objects))
+								if (ImGui::Button("+", ImVec2(ImGui::GetContentRegionAvail().x, 0)))
 								{
-									Object *object = &objects[numObjects++];
-									memset(object, 0, sizeof object[0]);
-									int index = numObjects;
-									FormatString(object->name, sizeof object->name, "Object%d", index);
+									int index = ListCount(objects);
+									InsertObject(index);
+									FormatString(objectInfos[index].name, sizeof objectInfos[index].name, "Object%d", index + 1);
 								}
 							}
 							ImGui::EndTable();
@@ -1212,9 +2088,12 @@ void Editor_Render()
 						ImGui::TableNextColumn();
 						ImGui::Spacing();
 						{
+							Object *selectedObject = ResolveObjectHandle(selectedHandle);
 							if (selectedObject)
 							{
-								ImGui::InputText("Name", selectedObject->name, sizeof selectedObject->name);
+								ObjectInfo *selectedInfo = GetInfo(selectedObject);
+
+								ImGui::InputText("Name", selectedInfo->name, sizeof selectedInfo->name);
 								ImGui::DragFloat2("Position", &selectedObject->position.x);
 
 								const char *direction = GetDirectionString(selectedObject->direction);
@@ -1232,11 +2111,11 @@ void Editor_Render()
 								ImGui::DragFloat("Z Offset", &selectedObject->zOffset);
 
 								char scriptPath[256];
-								CopyString(scriptPath, GetAssetPath(selectedObject->script), sizeof scriptPath);
+								CopyString(scriptPath, GetAssetPath(selectedInfo->script), sizeof scriptPath);
 								if (ImGui::InputText("Script", scriptPath, sizeof scriptPath, ImGuiInputTextFlags_EnterReturnsTrue))
 								{
-									ReleaseAsset(selectedObject->script);
-									selectedObject->script = AcquireScript(scriptPath, roboto, robotoBold, robotoItalic, robotoBoldItalic);
+									ReleaseAsset(selectedInfo->script);
+									selectedInfo->script = AcquireScript(scriptPath, &roboto, &robotoBold, &robotoItalic, &robotoBoldItalic);
 								}
 
 								ImGui::SliderFloat("Talk range", &selectedObject->talkRange, 1, 1000);
@@ -1265,15 +2144,18 @@ void Editor_Render()
 									}
 								}
 
+								// Any of the properties above could have moved the object, or changed its sprite or talk range.
+								MarkObjectAsMoved(selectedObject);
+
 								if (ImGui::CollapsingHeader("Expressions"))
 								{
-									for (int i = 0; i < COUNTOF(selectedObject->expressions); ++i)
+									for (int i = 0; i < COUNTOF(selectedInfo->expressions); ++i)
 									{
 										ImGui::PushID(i);
 										ImGui::BeginTable("ExpressionTable", 2, ImGuiTableFlags_SizingStretchProp);
 										ImGui::TableNextRow();
 										{
-											Expression *expression = &selectedObject->expressions[i];
+											Expression *expression = &selectedInfo->expressions[i];
 
 											ImGui::TableNextColumn();
 											ImGui::InputText("Name", expression->name, sizeof expression->name);
@@ -1321,6 +2203,7 @@ void Editor_Render()
 		}
 		ImGui::End();
 
+		Object *selectedObject = ResolveObjectHandle(selectedHandle);
 		List(Object *) sorted = GetZSortedObjects();
 		for (int i = ListCount(sorted) - 1; i >= 0; --i)
 		{
@@ -1341,13 +2224,13 @@ void Editor_Render()
 			outline = ExpandRectangle(outline, outlineThickness);
 			DrawRectangleLinesEx(outline, outlineThickness, outlineColor);
 
-			float z = GetFootPositionInScreenSpace(object).y + object->zOffset;
+			float z = object->zKey;
 			Vector2 zLinePos0 = { outline.x, z };
 			Vector2 zLinePos1 = { outline.x + outline.width, z };
 			DrawLineEx(zLinePos0, zLinePos1, 2, YELLOW);
 		}
 
-		if (options.showGrid and draggedObject)
+		if (options.showGrid and ResolveObjectHandle(draggedHandle))
 			DrawGrid();
 
 		if (isInStairsTab)
@@ -1378,20 +2261,22 @@ void Editor_Render()
 			{
 				if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
 				{
-					pressedObject = hoveredObject;
-					if (pressedObject == selectedObject)
+					pressedHandle = GetObjectHandle(hoveredObject);
+					if (hoveredObject == selectedObject)
 					{
-						draggedObject = hoveredObject;
-						draggedObjectFreeformPosition = draggedObject->position;
+						draggedHandle = pressedHandle;
+						if (hoveredObject)
+							draggedObjectFreeformPosition = hoveredObject->position;
 					}
 				}
 				if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT))
 				{
-					if (hoveredObject == pressedObject)
-						selectedObject = hoveredObject;
-					draggedObject = NULL;
+					if (hoveredObject == ResolveObjectHandle(pressedHandle))
+						selectedHandle = GetObjectHandle(hoveredObject);
+					draggedHandle = GetObjectHandle(NULL);
 				}
 
+				Object *draggedObject = ResolveObjectHandle(draggedHandle);
 				if (draggedObject)
 				{
 					Vector2 delta = GetMouseDelta();
@@ -1400,6 +2285,7 @@ void Editor_Render()
 					draggedObject->position = draggedObjectFreeformPosition;
 					if (options.showGrid)
 						draggedObject->position = SnapToGrid(draggedObjectFreeformPosition);
+					MarkObjectAsMoved(draggedObject);
 				}
 			}
 			else if (isInStairsTab)
@@ -1446,7 +2332,7 @@ void Editor_Render()
 				camera.target.y -= delta.y / camera.zoom;
 			}
 
-			if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) or (selectedObject and selectedObject == hoveredObject) or draggedObject)
+			if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) or (selectedObject and selectedObject == hoveredObject) or ResolveObjectHandle(draggedHandle))
 				SetMouseCursor(MOUSE_CURSOR_RESIZE_ALL);
 			else
 				SetMouseCursor(MOUSE_CURSOR_DEFAULT);
@@ -1479,7 +2365,7 @@ void Editor_Render()
 
 		bool controlIsDown = IsKeyDown(KEY_LEFT_CONTROL) or IsKeyDown(KEY_RIGHT_CONTROL) or IsKeyDown(KEY_LEFT_SUPER) or IsKeyDown(KEY_RIGHT_SUPER);
 		if (IsKeyPressed(KEY_D) and controlIsDown)
-			selectedObject = NULL;
+			selectedHandle = GetObjectHandle(NULL);
 		if (IsKeyPressed(KEY_S) and controlIsDown)
 			SaveScene(options.scene);
 		if (IsKeyPressed(KEY_R) and controlIsDown)
@@ -1507,16 +2393,20 @@ void Paused_Render(void)
 {
 	CallPreviousGameStateRender();
 	DrawRectangle(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, GrayscaleAlpha(0, 0.4f));
-	DrawFormatCentered(roboto, WINDOW_CENTER_X, WINDOW_CENTER_Y, 64, BLACK, "Paused");
+	DrawFormatCentered(&roboto, WINDOW_CENTER_X, WINDOW_CENTER_Y, 64, BLACK, "Paused");
 }
 REGISTER_GAME_STATE(GAMESTATE_PAUSED, NULL, NULL, Paused_Update, Paused_Render);
 
 void GameInit(void)
 {
-	SetConfigFlags(FLAG_MSAA_4X_HINT);
-	InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Who Stole The Sun");
-	InitAudioDevice();
-	SetTargetFPS(FPS);
+	#ifndef HEADLESS
+	{
+		SetConfigFlags(FLAG_MSAA_4X_HINT);
+		InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Who Stole The Sun");
+		InitAudioDevice();
+		SetTargetFPS(FPS);
+	}
+	#endif
 	
 	// Options
 	{
@@ -1528,6 +2418,10 @@ void GameInit(void)
 		CopyBytes(&options, data, bytesToCopy);
 	}
 
+	// Outside of dev mode, load assets from the pack if there is one. In dev mode we want loose files so we can hot-reload them.
+	if (not options.devMode)
+		MountAssetPack(ASSET_PACK_PATH);
+
 	// Input mapping
 	{
 		MapKeyToInputButton(KEY_SPACE, &input.interact);
@@ -1558,25 +2452,33 @@ void GameInit(void)
 		MapKeyToInputButton(KEY_F1, &input.console);
 	}
 
-	roboto = LoadFontAscii("roboto.ttf", 32);
-	robotoBold = LoadFontAscii("roboto-bold.ttf", 32);
-	robotoItalic = LoadFontAscii("roboto-italic.ttf", 32);
-	robotoBoldItalic = LoadFontAscii("roboto-bold-italic.ttf", 32);
-
-	LoadScene(options.scene);
+	roboto = LoadGameFont("roboto.ttf", 32);
+	robotoBold = LoadGameFont("roboto-bold.ttf", 32);
+	robotoItalic = LoadGameFont("roboto-italic.ttf", 32);
+	robotoBoldItalic = LoadGameFont("roboto-bold-italic.ttf", 32);
 
 	AddCommand("tp", HandlePlayerTeleportCommand, "tp x:float y:float  -  Teleport player");
 	AddCommand("dev", HandleToggleDevModeCommand, "dev [value:bool]  -  Toggle developer mode.");
+	AddCommand("profiler", HandleToggleProfilerCommand, "profiler [value:bool]  -  Toggle the frame profiler window.");
 	AddCommand("shake", HandleCameraShakeCommand, "shake [trauma:float] [falloff:float]  -  Trigger camera shake.");
 	AddCommand("sound", HandleSoundCommand,       "sound filename:string [volume:float] [pitch:float]  -  Play a sound.");
 	AddCommand("moveto", HandleMoveTo, "moveto dx:float dy:float  -  Start moving the player to a position.");
 	AddCommand("moveby", HandleMoveBy, "moveby dx:float dy:float  -  Start moving the player by a relative amount.");
 	AddCommand("save", HandleSaveCommand, "save [filename:string]  -  Saves current scene to a file.");
 	AddCommand("load", HandleLoadCommand, "load [filename:string]  -  Load a scene file.");
+	AddCommand("trace", HandleTraceCommand, "trace start | trace stop [filename:string]  -  Records zones, counters, and frames into a Chrome trace file.");
+	AddCommand("assetcache", HandleAssetCacheCommand, "assetcache [megabytes:float]  -  Shows how much memory unreferenced assets take up, or sets how much they can take up before being unloaded.");
+	AddCommand("pack", HandlePackCommand, "pack [filename:string]  -  Packs all assets into a single file, which is used instead of loose files outside of dev mode.");
+
+	// Scripts look up their commands when they load, so the commands need to exist before the scene does.
+	LoadScene(options.scene);
+	if (not player)
+		InsertObject(0); // The scene didn't load, but there always has to be a player.
 
 	SetCurrentGameState(GAMESTATE_PLAYING, NULL);
 }
 void GameDeinit(void)
 {
 	SaveFileData(".options", &options, sizeof options);
+	ShutdownJobs();
 }